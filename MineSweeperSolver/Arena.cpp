@@ -0,0 +1,42 @@
+#include "Arena.h"
+#include <bit>
+
+constinit thread_local GameArena *CurrentArena = nullptr;
+
+GameArena::GameArena(size_t capacity) : m_Buffer(std::make_unique<std::byte[]>(capacity)), m_Capacity(capacity), m_Used(0)
+{
+    m_Resource.emplace(m_Buffer.get(), m_Capacity, std::pmr::new_delete_resource());
+}
+
+GameArena::~GameArena() = default;
+
+void GameArena::Reset()
+{
+    m_Resource.reset();
+    if (m_Used > m_Capacity)
+    {
+        // so that the next game of the same kind fits
+        m_Capacity = std::bit_ceil(m_Used);
+        m_Buffer = std::make_unique<std::byte[]>(m_Capacity);
+    }
+    m_Used = 0;
+    m_Resource.emplace(m_Buffer.get(), m_Capacity, std::pmr::new_delete_resource());
+}
+
+size_t GameArena::GetCapacity() const
+{
+    return m_Capacity;
+}
+
+void *GameArena::do_allocate(size_t bytes, size_t alignment)
+{
+    m_Used += bytes + alignment - 1;
+    return m_Resource->allocate(bytes, alignment);
+}
+
+void GameArena::do_deallocate(void *p, size_t bytes, size_t alignment) { }
+
+bool GameArena::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+{
+    return this == &other;
+}
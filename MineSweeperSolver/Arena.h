@@ -0,0 +1,56 @@
+#pragma once
+#include "stdafx.h"
+#include <memory>
+#include <memory_resource>
+#include <optional>
+
+/* Monotonic memory for the scratch of one game, see CurrentArena
+ *
+ * Nothing is freed until Reset; the buffer then grows to what the game used,
+ * so that games of the same kind are eventually played without touching the heap.
+ *
+ * Note: Not thread-safe; use one per thread.
+ */
+class
+    GameArena : public std::pmr::memory_resource
+{
+public:
+    explicit GameArena(size_t capacity = 1 << 16);
+    ~GameArena() override;
+
+    GameArena(const GameArena &) = delete;
+    GameArena &operator=(const GameArena &) = delete;
+
+    /* Free everything allocated since the last Reset
+     *
+     * Note: Nothing allocated from the arena may be used afterwards.
+     */
+    void Reset();
+
+    [[nodiscard]] size_t GetCapacity() const;
+
+private:
+    std::unique_ptr<std::byte[]> m_Buffer;
+    size_t m_Capacity;
+    size_t m_Used; // bytes requested since the last Reset
+    std::optional<std::pmr::monotonic_buffer_resource> m_Resource;
+
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override;
+    [[nodiscard]] bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+};
+
+/* Arena of the current thread, reset by run() before each game; nullptr (the default) uses the heap */
+extern constinit thread_local GameArena *CurrentArena;
+
+/* Where solver and drainer scratch shall be allocated: CurrentArena, or the heap
+ *
+ * Note: Containers take the resource when constructed, and copies of them use the heap.
+ * So scratch must not outlive the GameMgr it belongs to.
+ */
+inline std::pmr::memory_resource *ScratchResource()
+{
+    if (CurrentArena)
+        return CurrentArena;
+    return std::pmr::new_delete_resource();
+}
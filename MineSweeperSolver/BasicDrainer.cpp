@@ -1,9 +1,10 @@
 #include "BasicDrainer.h"
+#include "Arena.h"
 
-static void Combinations(int n, int m, std::vector<std::vector<BlockStatus>> &dists)
+static void Combinations(int n, int m, std::pmr::vector<std::pmr::vector<BlockStatus>> &dists)
 {
     auto count = 0;
-    std::vector<BlockStatus> stack;
+    std::pmr::vector<BlockStatus> stack(ScratchResource());
     stack.reserve(n);
     auto add = [&count, &stack, n, m]()
         {
@@ -136,7 +137,7 @@ BasicDrainer::~BasicDrainer()
     }
 }
 
-BasicDrainer::BasicDrainer() : m_RootMacro(nullptr)
+BasicDrainer::BasicDrainer() : m_RootMacro(nullptr), m_Abandoned(false)
 {
     {
         auto macro = new MacroSituation();
@@ -162,15 +163,22 @@ size_t BasicDrainer::GetSteps() const
     return m_Micros.size();
 }
 
+bool BasicDrainer::GetAbandoned() const
+{
+    return m_Abandoned;
+}
+
 bool BasicDrainer::MakeProgress()
 {
+    if (m_Abandoned)
+        return false;
     if (m_MicroSolvingIter != m_Micros.end())
     {
 #ifndef NDEBUG
         std::cerr << "BasicDrainer::MakeProgress Processing #" << m_MicroSolvingIter - m_Micros.begin() << "\n";
 #endif
         SolveMicro(*m_MicroSolvingIter++, m_RootMacro);
-        return true;
+        return !m_Abandoned;
     }
 #ifndef NDEBUG
     std::cerr << "BasicDrainer::MakeProgress Post-processing\n";
@@ -272,12 +280,19 @@ void BasicDrainer::GenerateMicros(const std::vector<BlockSet> &sets, size_t tota
 
     m_Micros.reserve(totalStates);
 
-    std::vector<std::map<int, std::vector<std::map<int, BlockStatus>>>> dicc(sets.size());
-    std::vector<std::vector<std::map<int, BlockStatus>>*> ddic;
-    std::vector<std::vector<BlockStatus>> dists;
-    std::vector<int> stack;
-    for (auto solution : solutions)
+    // scratch only: all of it lives in the arena, if any
+    using Dic = std::pmr::vector<std::pmr::map<int, BlockStatus>>;
+    std::pmr::vector<std::pmr::map<int, Dic>> dicc(sets.size(), ScratchResource());
+    std::pmr::vector<Dic *> ddic(ScratchResource());
+    std::pmr::vector<std::pmr::vector<BlockStatus>> dists(ScratchResource());
+    std::pmr::vector<int> stack(ScratchResource());
+    for (auto &solution : solutions)
     {
+        if (m_Deadline.Expired())
+        {
+            m_Abandoned = true;
+            break;
+        }
         ddic.clear();
         for (auto i = 0; i < sets.size(); ++i)
         {
@@ -287,7 +302,7 @@ void BasicDrainer::GenerateMicros(const std::vector<BlockSet> &sets, size_t tota
             {
                 dists.clear();
                 Combinations(sets[i].size(), m, dists);
-                for (auto l : dists)
+                for (auto &l : dists)
                 {
                     lst.emplace_back();
                     auto &d = lst.back();
@@ -351,6 +366,11 @@ void BasicDrainer::GenerateRoot(Solver *solver, int toOpen)
 
 void BasicDrainer::SolveMicro(MicroSituation &micro, MacroSituation *macro)
 {
+    if (m_Abandoned || m_Deadline.Expired())
+    {
+        m_Abandoned = true;
+        return;
+    }
     macro->m_Micros.insert(&micro);
 
     BlockSet bests;
@@ -58,6 +58,10 @@ public:
     [[nodiscard]] size_t GetSteps() const;
     // to be called GetSteps() times, or until returning false
     [[nodiscard]] bool MakeProgress();
+    /* m_Deadline expired while generating or making progress;
+     * the drainer is incomplete and of no use.
+     */
+    [[nodiscard]] bool GetAbandoned() const;
 
     [[nodiscard]] double GetBestProb() const;
 protected:
@@ -65,6 +69,8 @@ protected:
     std::vector<BlockSet> m_BlocksR;
 
     MacroSituation *m_RootMacro;
+    // checked between solving macro situations, see GetAbandoned
+    Deadline m_Deadline;
 
     void GenerateMicros(const std::vector<BlockSet> &sets, size_t totalStates, const std::vector<Solution> &solutions);
 #ifdef USE_BASIC_SOLVER
@@ -83,6 +89,7 @@ private:
     std::multimap<size_t, MacroSituation *> m_Macros;
 
     MacroSituation *m_SucceedMacro, *m_FailMacro;
+    bool m_Abandoned;
 
     MacroSituation *GetOrAddMacroSituation(MacroSituation *&macro);
 
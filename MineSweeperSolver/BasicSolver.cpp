@@ -1,15 +1,53 @@
 #include "BasicSolver.h"
 #include <algorithm>
+#include <array>
+#include <bit>
+#include "Arena.h"
 #include "BinomialHelper.h"
+#include "Profile.h"
+#include "Snapshot.h"
+#include <cmath>
 #include <map>
+#include <random>
+#include <utility>
 
 #define ZEROQ(val) (std::abs(val) < 1E-4)
 
 #define M(x, y) matrix[(x) * height + (y)]
 
+// a tenth of a second or so; expert boards stay under 1E5
+#define DEFAULT_ENUMERATION_BUDGET 1E6
+// see SampleSolutions
+#define SAMPLE_STEPS (1 << 18)
+#define SAMPLE_BATCHES 32
+#define SAMPLE_SNAPSHOTS 256
+#define SAMPLE_SEED 0x5DEECE66DULL
+
 #define CONT_WIDTH(lst, cnt) ((cnt) == (lst).size() - 1 && SHF(m_BlockSets.size()) > 0 ? SHF(m_BlockSets.size()) : CONT_SIZE)
 
-BasicSolver::BasicSolver(size_t count) : CanOpenForSure(0), m_State(SolvingState::Stale), m_Manager(count, BlockStatus::Unknown), m_Probability(count), m_TotalStates(NAN), m_Pairs_Temp(nullptr), m_Pairs_Temp_Size(0), m_RestMines(-1)
+// there are never more sets than blocks, so CONTS(count) containers hold any row
+BasicSolver::CheckSolutionsKernel BasicSolver::CheckSolutionsOf(size_t count)
+{
+    switch (CONTS(count))
+    {
+    case 1:
+        return &BasicSolver::CheckSolutions<1>;
+    case 2: // beginner
+        return &BasicSolver::CheckSolutions<2>;
+    case 3:
+    case 4: // intermediate
+        return &BasicSolver::CheckSolutions<4>;
+    case 5:
+    case 6:
+    case 7:
+    case 8: // expert
+        return &BasicSolver::CheckSolutions<8>;
+    default:
+        return &BasicSolver::CheckSolutionsGeneric;
+    }
+}
+
+BasicSolver::BasicSolver(size_t count) : CanOpenForSure(0), m_State(SolvingState::Stale), m_Manager(count, BlockStatus::Unknown), m_Probability(count), m_TotalStates(NAN), m_Pairs_Temp(nullptr), m_Pairs_Temp_Size(0), m_RestMines(-1), m_Infeasible(false), m_Truncated(false), m_EnumerationBudget(DEFAULT_ENUMERATION_BUDGET), m_StandardError(0), m_CheckSolutions(CheckSolutionsOf(count))
 {
     m_BlockSets.emplace_back(count);
     auto &lst = m_BlockSets.back();
@@ -19,7 +57,7 @@ BasicSolver::BasicSolver(size_t count) : CanOpenForSure(0), m_State(SolvingState
     m_Matrix.emplace_back();
 }
 
-BasicSolver::BasicSolver(size_t count, int mines) : CanOpenForSure(0), m_State(SolvingState::Stale), m_Manager(count, BlockStatus::Unknown), m_Probability(count), m_TotalStates(Binomial((int)count, mines)), m_Pairs_Temp(nullptr), m_Pairs_Temp_Size(0), m_RestMines(mines)
+BasicSolver::BasicSolver(size_t count, int mines) : CanOpenForSure(0), m_State(SolvingState::Stale), m_Manager(count, BlockStatus::Unknown), m_Probability(count), m_TotalStates(Binomial((int)count, mines)), m_Pairs_Temp(nullptr), m_Pairs_Temp_Size(0), m_RestMines(mines), m_Infeasible(false), m_Truncated(false), m_EnumerationBudget(DEFAULT_ENUMERATION_BUDGET), m_StandardError(0), m_CheckSolutions(CheckSolutionsOf(count))
 {
     m_BlockSets.emplace_back(count);
     auto &lst = m_BlockSets.back();
@@ -31,13 +69,103 @@ BasicSolver::BasicSolver(size_t count, int mines) : CanOpenForSure(0), m_State(S
     m_MatrixAugment.push_back(mines);
 }
 
-BasicSolver::BasicSolver(const BasicSolver &other) : CanOpenForSure(other.CanOpenForSure), m_State(other.m_State), m_Manager(other.m_Manager), m_BlockSets(other.m_BlockSets), m_SetIDs(other.m_SetIDs), m_Matrix(other.m_Matrix), m_MatrixAugment(other.m_MatrixAugment), m_Minors(other.m_Minors), m_Solutions(other.m_Solutions), m_Probability(other.m_Probability), m_TotalStates(other.m_TotalStates), m_Pairs_Temp(nullptr), m_Pairs_Temp_Size(0), m_RestMines(other.m_RestMines) { }
+BasicSolver::BasicSolver(const BasicSolver &other) : CanOpenForSure(other.CanOpenForSure), m_State(other.m_State), m_Manager(other.m_Manager), m_BlockSets(other.m_BlockSets), m_SetIDs(other.m_SetIDs), m_Matrix(other.m_Matrix), m_MatrixAugment(other.m_MatrixAugment), m_Minors(other.m_Minors), m_Solutions(other.m_Solutions), m_Probability(other.m_Probability), m_TotalStates(other.m_TotalStates), m_Pairs_Temp(nullptr), m_Pairs_Temp_Size(0), m_RestMines(other.m_RestMines), m_Infeasible(other.m_Infeasible), m_Truncated(other.m_Truncated), m_EnumerationBudget(other.m_EnumerationBudget), m_StandardError(other.m_StandardError), m_CheckSolutions(other.m_CheckSolutions) { }
 
 BasicSolver::~BasicSolver()
 {
     delete[] m_Pairs_Temp;
 }
 
+void BasicSolver::Reset(int mines)
+{
+    auto count = m_Manager.size();
+    CanOpenForSure = 0;
+    m_State = SolvingState::Stale;
+    std::fill(m_Manager.begin(), m_Manager.end(), BlockStatus::Unknown);
+    m_BlockSets.resize(1);
+    auto &lst = m_BlockSets.front();
+    lst.resize(count);
+    for (auto i = 0; i < count; ++i)
+        lst[i] = i;
+    std::fill(m_SetIDs.begin(), m_SetIDs.end(), 0);
+    m_Matrix.resize(1);
+    m_Matrix.front().clear();
+    m_MatrixAugment.clear();
+    if (mines >= 0)
+    {
+        m_Matrix.front().push_back(1);
+        m_MatrixAugment.push_back(mines);
+    }
+    m_Minors.clear();
+    m_Solutions.clear();
+    std::fill(m_Probability.begin(), m_Probability.end(), 0);
+    m_TotalStates = mines >= 0 ? Binomial((int)count, mines) : NAN;
+    m_RestMines = mines;
+    m_Infeasible = false;
+    m_Deadline = Deadline{};
+    m_Truncated = false;
+    m_StandardError = 0;
+    // SimpleOverlapAll forgets the pairs once they outgrow it, so its size is part of the state
+    delete[] m_Pairs_Temp;
+    m_Pairs_Temp = nullptr;
+    m_Pairs_Temp_Size = 0;
+}
+
+Deadline::Deadline() : m_At(std::chrono::steady_clock::time_point::max()) { }
+
+Deadline::Deadline(std::chrono::steady_clock::duration budget) : Deadline()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (budget < m_At - now)
+        m_At = now + budget;
+}
+
+Deadline::Deadline(std::chrono::steady_clock::duration budget, std::shared_ptr<const std::atomic<bool>> cancelled) : Deadline(budget)
+{
+    m_Cancelled = std::move(cancelled);
+}
+
+Deadline Deadline::Within(std::chrono::steady_clock::duration budget) const
+{
+    auto deadline = *this;
+    auto now = std::chrono::steady_clock::now();
+    if (budget < deadline.m_At - now)
+        deadline.m_At = now + budget;
+    return deadline;
+}
+
+bool Deadline::Expired() const
+{
+    if (m_Cancelled && m_Cancelled->load(std::memory_order_relaxed))
+        return true;
+    return m_At != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() >= m_At;
+}
+
+void BasicSolver::SetDeadline(Deadline deadline)
+{
+    m_Deadline = deadline;
+}
+
+bool BasicSolver::GetTruncated() const
+{
+    return m_Truncated;
+}
+
+void BasicSolver::SetEnumerationBudget(double leaves)
+{
+    m_EnumerationBudget = leaves;
+}
+
+bool BasicSolver::GetApproximate() const
+{
+    return (m_State & SolvingState::Approximate) == SolvingState::Approximate;
+}
+
+double BasicSolver::GetStandardError() const
+{
+    return m_StandardError;
+}
+
 BlockStatus BasicSolver::GetBlockStatus(Block block) const
 {
     return m_Manager[block];
@@ -85,7 +213,7 @@ void BasicSolver::AddRestrain(Block blk, bool isMine)
         m_State = SolvingState::Stale;
         return;
     }
-    m_State &= SolvingState::Reduce | SolvingState::Overlap | SolvingState::Probability;
+    m_State &= SolvingState::Reduce | SolvingState::Overlap | SolvingState::Probability | SolvingState::Approximate;
     if (m_Manager[blk] == BlockStatus::Blank && isMine)
         throw std::runtime_error("blank is not blank at " + std::to_string(blk));
     if (m_Manager[blk] == BlockStatus::Mine && !isMine)
@@ -182,13 +310,38 @@ void BasicSolver::AddRestrain(const BlockSet &set, int mines)
 
 bool BasicSolver::Solve(SolvingState maxDepth, bool shortcut)
 {
+    auto status = TrySolve(maxDepth, shortcut);
+    if (status == SolveStatus::Infeasible)
+        throw Infeasible{};
+    return status == SolveStatus::Changed;
+}
+
+SolvingState BasicSolver::Solve(SolvingState maxDepth, bool shortcut, Deadline deadline)
+{
+    auto saved = std::exchange(m_Deadline, std::move(deadline));
+    auto status = TrySolve(maxDepth, shortcut);
+    m_Deadline = std::move(saved);
+    if (status == SolveStatus::Infeasible)
+        throw Infeasible{};
+    return m_State & (maxDepth | SolvingState::Approximate);
+}
+
+SolveStatus BasicSolver::TrySolve(SolvingState maxDepth, bool shortcut)
+{
+    if (m_Infeasible)
+        return SolveStatus::Infeasible;
+
     if ((m_State & maxDepth) == maxDepth)
-        return false;
+        return SolveStatus::Unchanged;
 
     if (shortcut && CanOpenForSure > 0)
-        return false;
+        return SolveStatus::Unchanged;
+
+    if (CurrentProfile)
+        CurrentProfile->Solves++;
 
     m_Solutions.clear();
+    m_Truncated = false;
 
     // 1. Compute iteratively: (Reduce+ Overlap)+
     while (true)
@@ -196,28 +349,32 @@ bool BasicSolver::Solve(SolvingState maxDepth, bool shortcut)
         while ((m_State & SolvingState::Reduce) == SolvingState::Stale)
         {
             ReduceRestrains();
+            if (m_Infeasible)
+                return SolveStatus::Infeasible;
             if (shortcut && CanOpenForSure > 0)
-                return true;
+                return SolveStatus::Changed;
         }
         if ((maxDepth & SolvingState::Overlap) == SolvingState::Stale)
             break;
         SimpleOverlapAll();
+        if (m_Infeasible)
+            return SolveStatus::Infeasible;
         if (shortcut && CanOpenForSure > 0)
-            return true;
+            return SolveStatus::Changed;
         if ((m_State & SolvingState::Overlap) == SolvingState::Overlap)
             break;
     }
     MergeSets();
 
     if ((maxDepth & SolvingState::Probability) == SolvingState::Stale)
-        return true;
+        return SolveStatus::Changed;
 
     if ((m_State & SolvingState::Probability) == SolvingState::Probability)
-        return true;
+        return SolveStatus::Changed;
 
     // 2. Compute Probability using Gauss elimination
 
-    m_State |= SolvingState::Probability;
+    m_State = (m_State | SolvingState::Probability) & ~SolvingState::Approximate;
 
     if (m_BlockSets.empty())
     {
@@ -225,12 +382,12 @@ bool BasicSolver::Solve(SolvingState maxDepth, bool shortcut)
 
         m_Solutions.emplace_back();
         ProcessSolutions();
-        return true;
+        return m_Infeasible ? SolveStatus::Infeasible : SolveStatus::Changed;
     }
 
     auto width = m_BlockSets.size() + 1;
     auto height = m_Matrix.front().size();
-    auto matrix = new double[width * height];
+    std::pmr::vector<double> matrix(width * height, ScratchResource());
     for (auto col = 0; col < width - 1; ++col)
         for (auto row = 0; row < height; ++row)
             if (NZ(m_Matrix[CNT(col)][row], SHF(col)))
@@ -239,32 +396,241 @@ bool BasicSolver::Solve(SolvingState maxDepth, bool shortcut)
                 M(col, row) = 0;
     for (auto row = 0; row < height; ++row)
         M(m_BlockSets.size(), row) = m_MatrixAugment[row];
-    Gauss(matrix, width, height);
+    Gauss(matrix.data(), width, height);
 
     if (!m_Minors.empty() &&
             m_Minors.back() == m_BlockSets.size())
         m_Minors.pop_back();
     else
     {
-        delete[] matrix;
         m_TotalStates = double(0);
-        return true;
+        return SolveStatus::Changed;
     }
 
-    EnumerateSolutions(matrix, width, height);
-    delete[] matrix;
+    m_StandardError = 0;
+    auto sampled = EnumerationSize() > m_EnumerationBudget;
+    // if sampled, a solution to start from, found the same way as when enumerating
+    EnumerateSolutions(matrix.data(), width, height, sampled);
+    if (sampled && !m_Truncated && !m_Solutions.empty())
+        SampleSolutions(matrix.data(), width, height, SAMPLE_STEPS, true);
+
+    if (m_Truncated)
+    {
+        m_State &= ~(SolvingState::Probability | SolvingState::Approximate);
+        // out of time: leave the probabilities as they were
+        if (m_Solutions.empty())
+            return SolveStatus::Changed;
+        // ... unless some solutions were found: a short chain from one of them beats stale probabilities
+        SampleSolutions(matrix.data(), width, height, SAMPLE_STEPS / 16, false);
+        m_State |= SolvingState::Approximate;
+        return SolveStatus::Changed;
+    }
 
     if (m_Solutions.empty())
     {
         m_TotalStates = double(0);
-        return true;
+        return SolveStatus::Changed;
+    }
+
+    if (sampled)
+    {
+        m_State |= SolvingState::Approximate;
+        return SolveStatus::Changed;
     }
 
     ProcessSolutions();
-    return true;
+    return m_Infeasible ? SolveStatus::Infeasible : SolveStatus::Changed;
+}
+
+void BasicSolver::Deflate(SnapshotWriter &sw) const
+{
+    sw.Signed(CanOpenForSure);
+    sw.Unsigned(static_cast<uint64_t>(m_State));
+    sw.Signed(m_RestMines);
+    sw.Double(m_TotalStates);
+
+    // 2 bits per block
+    for (auto i = 0; i < m_Manager.size(); i += 4)
+    {
+        uint8_t v = 0;
+        for (auto j = 0; j < 4 && i + j < m_Manager.size(); ++j)
+            switch (m_Manager[i + j])
+            {
+                case BlockStatus::Mine:
+                    v |= 1 << (2 * j);
+                    break;
+                case BlockStatus::Blank:
+                    v |= 2 << (2 * j);
+                    break;
+                default:
+                    break;
+            }
+        sw.Byte(v);
+    }
+
+    // m_SetIDs is implied by m_BlockSets and m_Manager
+    sw.Unsigned(m_BlockSets.size());
+    for (auto &set : m_BlockSets)
+    {
+        sw.Unsigned(set.size());
+        auto last = 0;
+        for (auto blk : set)
+            sw.Signed(blk - last), last = blk;
+        sw.Double(set.empty() ? 0 : m_Probability[set.front()]);
+    }
+
+    sw.Unsigned(m_MatrixAugment.size());
+    for (auto v : m_MatrixAugment)
+        sw.Signed(v);
+    sw.Unsigned(m_Matrix.size());
+    for (auto &containers : m_Matrix)
+    {
+        ASSERT(containers.size() == m_MatrixAugment.size());
+        sw.Raw(containers.data(), containers.size() * sizeof(Container));
+    }
+
+    sw.Unsigned(m_Solutions.size());
+    for (auto &so : m_Solutions)
+    {
+        sw.Unsigned(so.Dist.size());
+        for (auto v : so.Dist)
+            sw.Unsigned(v);
+        sw.Double(so.States);
+    }
 }
 
-void BasicSolver::GetIntersectionCounts(const BlockSet &set1, std::vector<int> &sets1, int &mines) const
+void BasicSolver::Inflate(SnapshotReader &sr)
+{
+    CanOpenForSure = static_cast<int>(sr.Signed());
+    m_State = static_cast<SolvingState>(sr.Unsigned());
+    m_Infeasible = false;
+    m_Truncated = false;
+    m_StandardError = (m_State & SolvingState::Approximate) == SolvingState::Approximate ? NAN : 0; // not kept by Deflate
+    auto restMines = sr.Signed();
+    if (restMines < -1 || restMines > static_cast<int64_t>(m_Manager.size()))
+        throw std::runtime_error("snapshot mine count out of range");
+    m_RestMines = static_cast<int>(restMines);
+    m_TotalStates = sr.Double();
+
+    for (auto i = 0; i < m_Manager.size(); i += 4)
+    {
+        auto v = sr.Byte();
+        for (auto j = 0; j < 4 && i + j < m_Manager.size(); ++j, v >>= 2)
+            switch (v & 3)
+            {
+                case 1:
+                    m_Manager[i + j] = BlockStatus::Mine;
+                    m_SetIDs[i + j] = -1;
+                    m_Probability[i + j] = 1;
+                    break;
+                case 2:
+                    m_Manager[i + j] = BlockStatus::Blank;
+                    m_SetIDs[i + j] = -2;
+                    m_Probability[i + j] = 0;
+                    break;
+                default:
+                    m_Manager[i + j] = BlockStatus::Unknown;
+                    break;
+            }
+    }
+
+    m_BlockSets.resize(sr.Count());
+    if (m_BlockSets.size() > m_Manager.size())
+        throw std::runtime_error("snapshot has too many sets");
+    for (auto i = 0; i < m_BlockSets.size(); ++i)
+    {
+        auto &set = m_BlockSets[i];
+        set.resize(sr.Count());
+        if (set.size() > m_Manager.size())
+            throw std::runtime_error("snapshot set too large");
+        auto last = 0;
+        for (auto &blk : set)
+        {
+            blk = last += static_cast<int>(sr.Signed());
+            if (blk < 0 || blk >= m_Manager.size())
+                throw std::runtime_error("snapshot block out of range");
+            m_SetIDs[blk] = i;
+        }
+        auto p = sr.Double();
+        for (auto blk : set)
+            m_Probability[blk] = p;
+    }
+
+    m_MatrixAugment.resize(sr.Count());
+    if (m_MatrixAugment.size() > m_Manager.size() + 1)
+        throw std::runtime_error("snapshot has too many restrains");
+    for (auto &v : m_MatrixAugment)
+        v = static_cast<int>(sr.Signed());
+    // one column per set, as CheckSolutions reads every set's bit
+    m_Matrix.resize(sr.Count());
+    if (m_Matrix.size() != CONTS(m_BlockSets.size()))
+        throw std::runtime_error("snapshot matrix does not match the sets");
+    for (auto &containers : m_Matrix)
+    {
+        containers.resize(m_MatrixAugment.size());
+        sr.Raw(containers.data(), containers.size() * sizeof(Container));
+    }
+    if (!m_Matrix.empty() && m_BlockSets.size() % CONT_SIZE != 0)
+        for (auto v : m_Matrix.back())
+            if (v >> m_BlockSets.size() % CONT_SIZE)
+                throw std::runtime_error("snapshot matrix has bits beyond the sets");
+
+    m_Minors.clear();
+    m_Solutions.resize(sr.Count());
+    for (auto &so : m_Solutions)
+    {
+        so.Dist.resize(sr.Count());
+        // may run past the sets, as EnumerateSolutions keeps every row when there are no minors
+        if (so.Dist.size() < m_BlockSets.size())
+            throw std::runtime_error("snapshot solution does not match the sets");
+        for (auto i = 0; i < so.Dist.size(); ++i)
+        {
+            auto v = sr.Unsigned();
+            if (v > (i < m_BlockSets.size() ? m_BlockSets[i].size() : m_Manager.size()))
+                throw std::runtime_error("snapshot solution out of range");
+            so.Dist[i] = static_cast<int>(v);
+        }
+        so.States = sr.Double();
+        so.Ratio = so.States / m_TotalStates;
+    }
+
+    delete[] m_Pairs_Temp;
+    m_Pairs_Temp = nullptr;
+    m_Pairs_Temp_Size = 0;
+#ifndef NDEBUG
+    CheckForConsistency(false);
+#endif
+}
+
+template <typename T, typename A>
+static size_t Bytes(const std::vector<T, A> &vec)
+{
+    return vec.capacity() * sizeof(T);
+}
+
+size_t BasicSolver::MemoryUsage() const
+{
+    auto sz = Bytes(m_Manager) + Bytes(m_BlockSets) + Bytes(m_SetIDs) + Bytes(m_Matrix)
+        + Bytes(m_MatrixAugment) + Bytes(m_Minors) + Bytes(m_Solutions) + Bytes(m_Probability);
+    for (auto &set : m_BlockSets)
+        sz += Bytes(set);
+    for (auto &containers : m_Matrix)
+        sz += Bytes(containers);
+    for (auto &so : m_Solutions)
+        sz += Bytes(so.Dist);
+
+    sz += Bytes(m_Reduce_Temp) + Bytes(m_ReduceCount_Temp) + Bytes(m_IntersectionCounts_Temp)
+        + m_Pairs_Temp_Size * sizeof(bool) + Bytes(m_OverlapIndexes_Temp)
+        + Bytes(m_OverlapA_Temp) + Bytes(m_OverlapB_Temp) + Bytes(m_OverlapC_Temp)
+        + Bytes(m_GaussVec_Temp) + Bytes(m_NonZero_Temp) + Bytes(m_Counts_Temp)
+        + Bytes(m_Majors_Temp) + Bytes(m_Stack_Temp) + Bytes(m_Dist_Temp)
+        + Bytes(m_Sums_Temp) + Bytes(m_Exp_Temp);
+    for (auto &nz : m_NonZero_Temp)
+        sz += Bytes(nz);
+    return sz;
+}
+
+void BasicSolver::GetIntersectionCounts(const BlockSet &set1, std::pmr::vector<int> &sets1, int &mines) const
 {
     sets1.clear();
     sets1.resize(m_BlockSets.size(), 0);
@@ -356,7 +722,7 @@ bool BasicSolver::ReduceBlockSet(int col)
                 ASSERT(false);
         }
     }
-    setN.swap(m_BlockSets[col]);
+    m_BlockSets[col].assign(setN.begin(), setN.end()); // never grows, and the scratch keeps its capacity
     if (dMines != 0)
     {
         for (auto j = 0; j < m_Matrix[CNT(col)].size(); ++j)
@@ -404,7 +770,10 @@ bool BasicSolver::ReduceRestrainMine(int row)
 {
     auto &sum = m_ReduceCount_Temp;
     if (m_MatrixAugment[row] > sum[row])
-        throw Infeasible{};
+    {
+        m_Infeasible = true;
+        return false;
+    }
     if (m_MatrixAugment[row] != sum[row])
         return false;
 
@@ -419,7 +788,10 @@ bool BasicSolver::ReduceRestrainMine(int row)
                 m_MatrixAugment[j] -= (int)m_BlockSets[col].size();
                 sum[j] -= m_BlockSets[col].size();
                 if (m_MatrixAugment[j] < 0)
-                    throw Infeasible{};
+                {
+                    m_Infeasible = true;
+                    return false;
+                }
             }
         for (auto blk : m_BlockSets[col])
         {
@@ -469,7 +841,7 @@ void BasicSolver::InversedReduceRestrainMine(int row)
 
 void BasicSolver::MergeSets()
 {
-    std::multimap<size_t, int> hash;
+    std::pmr::multimap<size_t, int> hash(ScratchResource());
     for (auto i = 0; i < m_BlockSets.size(); ++i)
     {
         size_t h = 5381;
@@ -509,6 +881,7 @@ void BasicSolver::MergeSets()
 
 void BasicSolver::ReduceRestrains()
 {
+    PhaseTimer pt{ Phase::Reduce };
     m_State |= SolvingState::Reduce;
 
     for (auto col = 0; col < m_BlockSets.size(); ++col)
@@ -523,7 +896,10 @@ void BasicSolver::ReduceRestrains()
     {
         for (auto v : m_MatrixAugment)
             if (v)
-                throw Infeasible{};
+            {
+                m_Infeasible = true;
+                return;
+            }
         m_MatrixAugment.clear();
         return;
     }
@@ -545,6 +921,8 @@ void BasicSolver::ReduceRestrains()
     for (auto row = 0; row < m_MatrixAugment.size(); ++row)
         if (ReduceRestrainMine(row))
             --row;
+        else if (m_Infeasible)
+            return;
 
     if (m_RestMines >= 0)
         for (auto row = 0; row < m_MatrixAugment.size(); ++row)
@@ -553,6 +931,7 @@ void BasicSolver::ReduceRestrains()
 
 void BasicSolver::SimpleOverlapAll()
 {
+    PhaseTimer pt{ Phase::Overlap };
     m_State |= SolvingState::Overlap;
 
     auto d = m_MatrixAugment.size();
@@ -584,6 +963,8 @@ void BasicSolver::SimpleOverlapAll()
                             m_State = SolvingState::Stale;
                             return;
                         }
+                        if (m_Infeasible)
+                            return;
 
                         m_Pairs_Temp[id] = true;
                     }
@@ -659,7 +1040,10 @@ bool BasicSolver::SimpleOverlap(int r1, int r2)
                             if (m_Manager[blk] == BlockStatus::Mine)
                                 continue;
                             if (m_Manager[blk] != BlockStatus::Unknown)
-                                throw Infeasible{};
+                            {
+                                m_Infeasible = true;
+                                return;
+                            }
                             m_Manager[blk] = BlockStatus::Mine;
                             m_RestMines--;
                             m_State = SolvingState::Stale;
@@ -680,7 +1064,10 @@ bool BasicSolver::SimpleOverlap(int r1, int r2)
                             if (m_Manager[blk] == BlockStatus::Blank)
                                 continue;
                             if (m_Manager[blk] != BlockStatus::Unknown)
-                                throw Infeasible{};
+                            {
+                                m_Infeasible = true;
+                                return;
+                            }
                             m_Manager[blk] = BlockStatus::Blank;
                             ++CanOpenForSure;
                             m_State = SolvingState::Stale;
@@ -692,14 +1079,17 @@ bool BasicSolver::SimpleOverlap(int r1, int r2)
     };
 
     proc(exceptA, ivA0, ivA);
-    proc(exceptB, ivB0, ivB);
-    proc(intersection, ivC0, ivC);
+    if (!m_Infeasible)
+        proc(exceptB, ivB0, ivB);
+    if (!m_Infeasible)
+        proc(intersection, ivC0, ivC);
 
     return false;
 }
 
 void BasicSolver::Gauss(double *matrix, size_t width, size_t height)
 {
+    PhaseTimer pt{ Phase::Gauss };
     m_Minors.clear();
     auto major = 0;
     for (auto col = 0; col < width; ++col)
@@ -760,9 +1150,53 @@ void BasicSolver::Gauss(double *matrix, size_t width, size_t height)
     }
 }
 
-void BasicSolver::EnumerateSolutions(const double *matrix, size_t width, size_t height)
+double BasicSolver::EnumerationSize() const
+{
+    double leaves = 1;
+    for (auto col : m_Minors)
+        leaves *= m_BlockSets[col].size() + 1;
+    return leaves;
+}
+
+void BasicSolver::SplitMinors(const double *matrix, size_t width, size_t height)
 {
     auto n = m_BlockSets.size();
+    auto mR = n - m_Minors.size();
+    auto &majors = m_Majors_Temp;
+    auto &cnts = m_Counts_Temp;
+    auto &sums = m_Sums_Temp;
+    majors.clear() , majors.reserve(mR);
+    cnts.clear() , cnts.reserve(mR);
+    sums.clear() , sums.reserve(mR);
+    m_NonZero_Temp.reserve(m_Minors.size());
+    auto minorID = 0;
+    auto mainRow = 0;
+    for (auto col = 0; col < n; ++col)
+        if (minorID < m_Minors.size() &&
+                col == m_Minors[minorID])
+        {
+            if (minorID >= m_NonZero_Temp.size())
+                m_NonZero_Temp.emplace_back();
+            auto &lst = m_NonZero_Temp[minorID];
+            lst.clear();
+            for (auto row = 0; row < height; ++row)
+                if (!ZEROQ(M(col, row)))
+                    lst.push_back(row);
+            ++minorID;
+        }
+        else // major
+        {
+            majors.push_back(col);
+            cnts.push_back(m_BlockSets[col].size());
+            sums.push_back(M(n, mainRow));
+            ++mainRow;
+        }
+}
+
+void BasicSolver::EnumerateSolutions(const double *matrix, size_t width, size_t height, bool first)
+{
+    PhaseTimer pt{ Phase::Enumerate };
+    auto n = m_BlockSets.size();
 
     if (m_Minors.empty())
     {
@@ -774,38 +1208,11 @@ void BasicSolver::EnumerateSolutions(const double *matrix, size_t width, size_t
         return;
     }
 
+    SplitMinors(matrix, width, height);
     auto mR = n - m_Minors.size();
     auto &majors = m_Majors_Temp;
     auto &cnts = m_Counts_Temp;
     auto &sums = m_Sums_Temp;
-    majors.clear() , majors.reserve(mR);
-    cnts.clear() , cnts.reserve(mR);
-    sums.clear() , sums.reserve(mR);
-    m_NonZero_Temp.reserve(m_Minors.size());
-    {
-        auto minorID = 0;
-        auto mainRow = 0;
-        for (auto col = 0; col < n; ++col)
-            if (minorID < m_Minors.size() &&
-                    col == m_Minors[minorID])
-            {
-                if (minorID >= m_NonZero_Temp.size())
-                    m_NonZero_Temp.emplace_back();
-                auto &lst = m_NonZero_Temp[minorID];
-                lst.clear();
-                for (auto row = 0; row < height; ++row)
-                    if (!ZEROQ(M(col, row)))
-                        lst.push_back(row);
-                ++minorID;
-            }
-            else // major
-            {
-                majors.push_back(col);
-                cnts.push_back(m_BlockSets[col].size());
-                sums.push_back(M(n, mainRow));
-                ++mainRow;
-            }
-    }
 #define AGGR(val) \
     for (auto mainRow : m_NonZero_Temp[stack.size() - 1]) \
     sums[mainRow] -= (val) * M(m_Minors[stack.size() - 1], mainRow)
@@ -814,7 +1221,14 @@ void BasicSolver::EnumerateSolutions(const double *matrix, size_t width, size_t
     stack.clear();
     stack.reserve(m_Minors.size());
     stack.push_back(0);
-    while (true)
+    for (size_t steps = 1;; ++steps)
+    {
+        // checking the clock is not free
+        if (steps % 4096 == 0 && m_Deadline.Expired() || first && steps > m_EnumerationBudget)
+        {
+            m_Truncated = true;
+            return;
+        }
         if (stack.size() == m_Minors.size())
             if (stack.back() <= m_BlockSets[m_Minors.back()].size())
             {
@@ -844,6 +1258,8 @@ void BasicSolver::EnumerateSolutions(const double *matrix, size_t width, size_t
                         lst[m_Minors[minorID]] = stack[minorID];
                     m_Solutions.emplace_back();
                     m_Solutions.back().Dist.swap(lst);
+                    if (first)
+                        return;
                 }
 
                 AGGR(1);
@@ -869,33 +1285,195 @@ void BasicSolver::EnumerateSolutions(const double *matrix, size_t width, size_t
             AGGR(1);
             ++stack.back();
         }
+    }
+}
+
+void BasicSolver::SampleSolutions(const double *matrix, size_t width, size_t height, size_t steps, bool timed)
+{
+    PhaseTimer pt{ Phase::Sample };
+    auto n = m_BlockSets.size();
+    auto nm = m_Minors.size();
+    auto mR = n - nm;
+    auto &majors = m_Majors_Temp;
+    auto &cnts = m_Counts_Temp;
+
+    // lf[i] = log(i!), so that huge sets do not overflow
+    size_t largest = 0;
+    for (auto &set : m_BlockSets)
+        largest = MAX(largest, set.size());
+    std::pmr::vector<double> lf(largest + 1, 0, ScratchResource());
+    for (auto i = 1; i <= largest; ++i)
+        lf[i] = lf[i - 1] + std::log(static_cast<double>(i));
+    auto logBinomial = [&lf](size_t n, int m) { return lf[n] - lf[m] - lf[n - m]; };
+
+    std::pmr::vector<int> dist(m_Solutions.back().Dist.begin(), m_Solutions.back().Dist.end(), ScratchResource());
+    m_Solutions.clear();
+    // count of each major, but fractional while a proposal is being checked
+    std::pmr::vector<double> cur(mR, ScratchResource());
+    for (auto row = 0; row < mR; ++row)
+        cur[row] = dist[majors[row]];
+    std::pmr::vector<int> touched(ScratchResource());
+    std::pmr::vector<bool> marked(mR, false, ScratchResource());
+
+    // time-weighted sum of the count of each set within the current batch, and statistics of the batch means
+    std::pmr::vector<double> acc(n, 0, ScratchResource()), sum(n, 0, ScratchResource()), sq(n, 0, ScratchResource());
+    std::pmr::vector<size_t> since(n, 0, ScratchResource());
+    auto change = [&](int col, int val, size_t t) {
+        acc[col] += static_cast<double>(dist[col]) * (t - since[col]);
+        since[col] = t;
+        dist[col] = val;
+    };
+
+    // fixed seed, so that solving stays reproducible
+    std::mt19937_64 rng{ SAMPLE_SEED };
+    std::uniform_int_distribution<size_t> pick{ 0, nm - 1 };
+    std::uniform_real_distribution<double> uniform{ 0, 1 };
+    auto step = [&rng, this](size_t k) {
+        // symmetric, and wide enough for large sets to move around their mean
+        auto r = MAX(1, static_cast<int>(std::sqrt(m_BlockSets[m_Minors[k]].size()) / 2));
+        auto d = std::uniform_int_distribution<int>{ -r, r - 1 }(rng);
+        return d >= 0 ? d + 1 : d;
+    };
+
+    auto burn = steps / 8;
+    auto batch = (steps - burn) / SAMPLE_BATCHES;
+    auto snapshot = (steps - burn) / SAMPLE_SNAPSHOTS;
+    for (size_t t = 0;; ++t)
+    {
+        if (timed && t % 4096 == 0 && m_Deadline.Expired())
+        {
+            m_Truncated = true;
+            return;
+        }
+        if (t >= burn && (t - burn) % batch == 0)
+        {
+            for (auto col = 0; col < n; ++col)
+            {
+                acc[col] += static_cast<double>(dist[col]) * (t - since[col]);
+                since[col] = t;
+                if (t > burn)
+                {
+                    auto mean = acc[col] / batch;
+                    sum[col] += mean;
+                    sq[col] += mean * mean;
+                }
+                acc[col] = 0;
+            }
+        }
+        if (t == burn + batch * SAMPLE_BATCHES)
+            break;
+        if (t >= burn && (t - burn) % snapshot == 0)
+        {
+            m_Solutions.emplace_back();
+            m_Solutions.back().Dist.assign(dist.begin(), dist.end());
+        }
+
+        // propose to move one or two minors
+        size_t ks[2]{ pick(rng), 0 };
+        int ds[2]{ step(ks[0]), 0 };
+        auto moves = 1;
+        if (nm > 1 && (rng() & 1))
+        {
+            ks[1] = (ks[0] + 1 + pick(rng) % (nm - 1)) % nm;
+            ds[1] = step(ks[1]);
+            moves = 2;
+        }
+        auto valid = true;
+        auto dLog = 0.0;
+        for (auto i = 0; i < moves; ++i)
+        {
+            auto col = m_Minors[ks[i]];
+            auto val = dist[col] + ds[i];
+            if (val < 0 || val > m_BlockSets[col].size())
+            {
+                valid = false;
+                break;
+            }
+            dLog += logBinomial(m_BlockSets[col].size(), val) - logBinomial(m_BlockSets[col].size(), dist[col]);
+        }
+        if (!valid)
+            continue;
+
+        touched.clear();
+        for (auto i = 0; i < moves; ++i)
+            for (auto row : m_NonZero_Temp[ks[i]])
+            {
+                if (!marked[row])
+                    marked[row] = true, touched.push_back(row);
+                cur[row] -= ds[i] * M(m_Minors[ks[i]], row);
+            }
+        for (auto row : touched)
+        {
+            auto v = round(cur[row]);
+            if (!ZEROQ(v - cur[row]) || v < 0 || v > cnts[row])
+            {
+                valid = false;
+                break;
+            }
+            dLog += logBinomial(cnts[row], static_cast<int>(v)) - logBinomial(cnts[row], dist[majors[row]]);
+        }
+        if (valid && (dLog >= 0 || uniform(rng) < std::exp(dLog)))
+        {
+            for (auto i = 0; i < moves; ++i)
+                change(m_Minors[ks[i]], dist[m_Minors[ks[i]]] + ds[i], t);
+            for (auto row : touched)
+                change(majors[row], static_cast<int>(round(cur[row])), t);
+        }
+        for (auto row : touched)
+        {
+            cur[row] = dist[majors[row]];
+            marked[row] = false;
+        }
+    }
+
+    // solutions for the heuristics: the distinct ones sampled, each weighted as if enumerated
+    std::sort(m_Solutions.begin(), m_Solutions.end(), [](const Solution &lhs, const Solution &rhs) { return lhs.Dist < rhs.Dist; });
+    m_Solutions.erase(std::unique(m_Solutions.begin(), m_Solutions.end(), [](const Solution &lhs, const Solution &rhs) { return lhs.Dist == rhs.Dist; }), m_Solutions.end());
+    auto total = 0.0;
+    for (auto &so : m_Solutions)
+    {
+        so.States = double(1);
+        for (auto i = 0; i < n; ++i)
+            so.States *= Binomial((int)m_BlockSets[i].size(), so.Dist[i]);
+        total += so.States;
+    }
+    for (auto &so : m_Solutions)
+        so.Ratio = so.States / total;
+    m_TotalStates = NAN;
+
+    for (auto i = 0; i < m_Manager.size(); ++i)
+        if (m_Manager[i] == BlockStatus::Mine)
+            m_Probability[i] = 1;
+        else if (m_Manager[i] == BlockStatus::Blank)
+            m_Probability[i] = 0;
+    m_StandardError = 0;
+    for (auto col = 0; col < n; ++col)
+    {
+        if (m_BlockSets[col].empty())
+            continue;
+        auto size = static_cast<double>(m_BlockSets[col].size());
+        auto mean = sum[col] / SAMPLE_BATCHES;
+        auto var = MAX(0.0, (sq[col] - SAMPLE_BATCHES * mean * mean) / (SAMPLE_BATCHES - 1));
+        m_StandardError = MAX(m_StandardError, std::sqrt(var / SAMPLE_BATCHES) / size);
+        for (auto blk : m_BlockSets[col])
+            m_Probability[blk] = mean / size;
+    }
 }
 
 void BasicSolver::ProcessSolutions()
 {
+    PhaseTimer pt{ Phase::Process };
     auto &exp = m_Exp_Temp;
     exp.clear() , exp.resize(m_BlockSets.size(), 0);
     m_TotalStates = double(0);
-    std::vector<int> flags(m_BlockSets.size(), 3);
+    std::pmr::vector<int> flags(m_BlockSets.size(), 3, ScratchResource());
+    if (!(this->*m_CheckSolutions)(flags))
+    {
+        m_Infeasible = true;
+        return;
+    }
     for (auto &so : m_Solutions)
     {
-        for (auto row = 0; row < m_MatrixAugment.size(); ++row)
-        {
-            auto v = 0;
-            for (auto col = 0; col < m_BlockSets.size(); ++col)
-                if (NZ(m_Matrix[CNT(col)][row], SHF(col)))
-                {
-                    v += so.Dist[col];
-                    if (flags[col] == 0)
-                        continue;
-                    if (flags[col] & 1 && so.Dist[col] != 0)
-                        flags[col] &= ~1;
-                    if (flags[col] & 2 && so.Dist[col] != m_BlockSets[col].size())
-                        flags[col] &= ~2;
-                }
-            if (m_MatrixAugment[row] != v)
-                throw Infeasible{};
-        }
         so.States = double(1);
         for (auto i = 0; i < m_BlockSets.size(); ++i)
             so.States *= Binomial((int)m_BlockSets[i].size(), so.Dist[i]);
@@ -943,6 +1521,64 @@ void BasicSolver::ProcessSolutions()
     }
 }
 
+template <size_t Conts>
+bool BasicSolver::CheckSolutions(std::pmr::vector<int> &flags) const
+{
+    // the kernel is picked once by the size of the board, which the matrix should never outgrow
+    if (m_Matrix.size() > Conts)
+        return CheckSolutionsGeneric(flags);
+    std::pmr::vector<std::array<Container, Conts>> rows(m_MatrixAugment.size(), std::array<Container, Conts>{}, ScratchResource());
+    for (auto cnt = 0; cnt < m_Matrix.size(); ++cnt)
+        for (auto row = 0; row < m_MatrixAugment.size(); ++row)
+            rows[row][cnt] = cnt == m_Matrix.size() - 1 && SHF(m_BlockSets.size()) > 0
+                ? LB(m_Matrix[cnt][row], SHF(m_BlockSets.size()))
+                : m_Matrix[cnt][row];
+
+    for (auto &so : m_Solutions)
+        for (auto row = 0; row < m_MatrixAugment.size(); ++row)
+        {
+            auto v = 0;
+            for (auto cnt = 0; cnt < Conts; ++cnt)
+                for (auto bits = rows[row][cnt]; bits != CONT_ZERO; bits &= bits - CONT_ONE)
+                {
+                    auto col = cnt * CONT_SIZE + std::countr_zero(bits);
+                    v += so.Dist[col];
+                    if (flags[col] == 0)
+                        continue;
+                    if (flags[col] & 1 && so.Dist[col] != 0)
+                        flags[col] &= ~1;
+                    if (flags[col] & 2 && so.Dist[col] != m_BlockSets[col].size())
+                        flags[col] &= ~2;
+                }
+            if (m_MatrixAugment[row] != v)
+                return false;
+        }
+    return true;
+}
+
+bool BasicSolver::CheckSolutionsGeneric(std::pmr::vector<int> &flags) const
+{
+    for (auto &so : m_Solutions)
+        for (auto row = 0; row < m_MatrixAugment.size(); ++row)
+        {
+            auto v = 0;
+            for (auto col = 0; col < m_BlockSets.size(); ++col)
+                if (NZ(m_Matrix[CNT(col)][row], SHF(col)))
+                {
+                    v += so.Dist[col];
+                    if (flags[col] == 0)
+                        continue;
+                    if (flags[col] & 1 && so.Dist[col] != 0)
+                        flags[col] &= ~1;
+                    if (flags[col] & 2 && so.Dist[col] != m_BlockSets[col].size())
+                        flags[col] &= ~2;
+                }
+            if (m_MatrixAugment[row] != v)
+                return false;
+        }
+    return true;
+}
+
 
 #ifndef NDEBUG
 void BasicSolver::CheckForConsistency(bool complete)
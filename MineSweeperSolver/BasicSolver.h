@@ -1,5 +1,9 @@
 #pragma once
 #include "stdafx.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <memory_resource>
 #include <vector>
 
 enum class BlockStatus
@@ -16,6 +20,9 @@ enum class SolvingState
     Overlap = 0x2,
     Probability = 0x4,
     Heuristic = 0x8,
+    // the probabilities were sampled: along with Probability, see BasicSolver::SetEnumerationBudget;
+    // without, from what a truncated enumeration found, see BasicSolver::GetTruncated
+    Approximate = 0x10,
     Drained = 0x8000
 };
 
@@ -24,6 +31,41 @@ struct Infeasible : std::runtime_error
     Infeasible() : std::runtime_error{ "infeasible" } { }
 };
 
+/* Outcome of BasicSolver::TrySolve */
+enum class SolveStatus
+{
+    Unchanged,
+    Changed,
+    Infeasible
+};
+
+/* Cooperative time limit, see GameMgr::SetDeadline
+ *
+ * Note: A default-constructed Deadline never expires.
+ */
+class
+    Deadline
+{
+public:
+    Deadline();
+    explicit Deadline(std::chrono::steady_clock::duration budget);
+    /* Also expires as soon as *<cancelled> is set, possibly by another thread */
+    Deadline(std::chrono::steady_clock::duration budget, std::shared_ptr<const std::atomic<bool>> cancelled);
+
+    [[nodiscard]] bool Expired() const;
+    /* The same deadline, but expiring <budget> from now at the latest */
+    [[nodiscard]] Deadline Within(std::chrono::steady_clock::duration budget) const;
+
+private:
+    std::chrono::steady_clock::time_point m_At;
+    std::shared_ptr<const std::atomic<bool>> m_Cancelled;
+};
+
+constexpr inline SolvingState operator~(SolvingState val)
+{
+    return static_cast<SolvingState>(~static_cast<int>(val));
+}
+
 constexpr inline SolvingState operator&(SolvingState lhs, SolvingState rhs)
 {
     return static_cast<SolvingState>(static_cast<int>(lhs) & static_cast<int>(rhs));
@@ -68,6 +110,8 @@ typedef size_t Container;
 #define CB(lval, shift) (lval) &= ~MASK((shift))
 
 struct Solution;
+class SnapshotWriter;
+class SnapshotReader;
 
 /* Determine which blocks must have mines, which blocks must not have mines.
  * It may also compute the probability of having a mine.
@@ -88,6 +132,11 @@ public:
     BasicSolver(const BasicSolver &other);
     virtual ~BasicSolver();
 
+    /* Forget everything, as if just constructed with <mines> (-1 for the constructor without),
+     * but keep the capacity of all buffers
+     */
+    virtual void Reset(int mines);
+
     // the user shall reduce this number, not BasicSolver
     // not doing so will not harm the operation of this class,
     // except for 'shortcut == true' to function
@@ -107,8 +156,64 @@ public:
      * shortcut == true: return immediately if any CanOpenForSure is found
      * shortcut == false: compute everything
      * return == true: found anything NEW to be open
+     *
+     * Note: Throws Infeasible if the restrains contradict; see TrySolve.
+     */
+    bool Solve(SolvingState maxDepth, bool shortcut);
+    /* Same as Solve, but give up on whatever is left once <deadline> has expired
+     * return: how far it got, i.e. the parts of <maxDepth> done,
+     *   plus SolvingState::Approximate if the probabilities were sampled
+     *
+     * Note: Reduce and Overlap always complete; probabilities come next, see GetTruncated.
+     * Note: The deadline set by SetDeadline is restored afterwards.
+     */
+    SolvingState Solve(SolvingState maxDepth, bool shortcut, Deadline deadline);
+    /* Same as Solve, but report contradicting restrains by return value
+     *
+     * Note: Once SolveStatus::Infeasible is returned, the solver is no longer usable.
+     */
+    [[nodiscard]] virtual SolveStatus TrySolve(SolvingState maxDepth, bool shortcut);
+
+    /* Stop enumerating solutions once <deadline> has expired, see GetTruncated
+     *
+     * Note: The deadline is NOT copied along with the solver.
+     */
+    void SetDeadline(Deadline deadline);
+    /* The last Solve ran out of time, or of enumeration budget while looking for a solution to sample from,
+     * before reaching SolvingState::Probability.
+     * If GetApproximate, probabilities and solutions were sampled from the solutions found in time;
+     * otherwise they are NOT up to date. Either way, solving again picks up from there.
+     */
+    [[nodiscard]] bool GetTruncated() const;
+
+    /* Sample solutions instead of enumerating them once there would be more than <leaves> to visit
+     * (the product of 1 + the size of each free set after Gauss elimination).
+     * Then probabilities are Monte Carlo estimates, see GetApproximate,
+     * solutions are the distinct ones sampled, and the total states are NAN.
+     *
+     * Note: Unlike the deadline, the budget is copied along with the solver, and kept by Reset.
      */
-    virtual bool Solve(SolvingState maxDepth, bool shortcut);
+    void SetEnumerationBudget(double leaves);
+    /* The probabilities were sampled rather than enumerated; nothing was inferred from the samples */
+    [[nodiscard]] bool GetApproximate() const;
+    /* Largest standard error of the probabilities if GetApproximate (NAN after Inflate), 0 otherwise */
+    [[nodiscard]] double GetStandardError() const;
+
+    /* Serialize everything needed to resume solving, see GameMgr::Deflate
+     *
+     * Note: Temporary buffers are NOT included.
+     * Note: Probabilities are only kept per set, which is exact
+     * as long as SolvingState::Probability has been reached.
+     */
+    void Deflate(SnapshotWriter &sw) const;
+    /* Restore what has been written by Deflate
+     *
+     * Note: The solver must be constructed with the same count.
+     */
+    virtual void Inflate(SnapshotReader &sr);
+
+    /* Approximate number of heap bytes held, including temporary buffers */
+    [[nodiscard]] virtual size_t MemoryUsage() const;
 
     friend class Drainer;
 protected:
@@ -136,11 +241,11 @@ protected:
      *
      * Note: <sets1> does NOT include confirmed mines NOR confirmed blanks.
      */
-    void GetIntersectionCounts(const BlockSet &set1, std::vector<int> &sets1, int &mines) const;
+    void GetIntersectionCounts(const BlockSet &set1, std::pmr::vector<int> &sets1, int &mines) const;
 private:
     BlockSet m_Reduce_Temp;
     std::vector<size_t> m_ReduceCount_Temp;
-    std::vector<int> m_IntersectionCounts_Temp;
+    std::pmr::vector<int> m_IntersectionCounts_Temp;
     bool *m_Pairs_Temp;
     size_t m_Pairs_Temp_Size;
     std::vector<int> m_OverlapIndexes_Temp;
@@ -153,6 +258,15 @@ private:
     std::vector<double> m_Exp_Temp;
 
     int m_RestMines;
+    // set instead of throwing Infeasible, checked by TrySolve
+    bool m_Infeasible;
+    Deadline m_Deadline;
+    bool m_Truncated;
+    double m_EnumerationBudget;
+    double m_StandardError;
+    typedef bool (BasicSolver::*CheckSolutionsKernel)(std::pmr::vector<int> &flags) const;
+    // CheckSolutions<CONTS(count)> for standard boards (up to 8 containers), or CheckSolutionsGeneric
+    CheckSolutionsKernel m_CheckSolutions;
 
     void DropColumn(int col);
     void DropRow(int row);
@@ -166,8 +280,32 @@ private:
     void SimpleOverlapAll();
     bool SimpleOverlap(int r1, int r2);
     void Gauss(double *matrix, size_t width, size_t height);
-    void EnumerateSolutions(const double *matrix, size_t width, size_t height);
+    /* Number of leaves EnumerateSolutions would visit */
+    [[nodiscard]] double EnumerationSize() const;
+    /* Fill m_Majors_Temp, m_Counts_Temp, m_Sums_Temp and m_NonZero_Temp from the eliminated matrix */
+    void SplitMinors(const double *matrix, size_t width, size_t height);
+    /* first == true: stop at the first solution, or once the budget is spent (see GetTruncated) */
+    void EnumerateSolutions(const double *matrix, size_t width, size_t height, bool first);
+    /* Estimate m_Probability by <steps> of Metropolis sampling over the free sets,
+     * starting from the last of m_Solutions, as left by EnumerateSolutions;
+     * a solution is weighted by its number of states, which respects m_RestMines through its row
+     *
+     * timed == false: do not check m_Deadline, which has already expired
+     */
+    void SampleSolutions(const double *matrix, size_t width, size_t height, size_t steps, bool timed);
     void ProcessSolutions();
+    /* Check m_Solutions against every restrain, and clear the bits of <flags> as in ProcessSolutions
+     * return == false: some solution breaks a restrain
+     *
+     * Note: The template keeps each row in <Conts> containers side by side and visits its set bits only;
+     * the solver picks the smallest that fits its blocks once, see m_CheckSolutions.
+     * Note: Falls back to CheckSolutionsGeneric if m_Matrix has more than <Conts> containers.
+     */
+    template <size_t Conts>
+    [[nodiscard]] bool CheckSolutions(std::pmr::vector<int> &flags) const;
+    [[nodiscard]] bool CheckSolutionsGeneric(std::pmr::vector<int> &flags) const;
+    /* The CheckSolutions for a board of <count> blocks */
+    static CheckSolutionsKernel CheckSolutionsOf(size_t count);
 
 #ifndef NDEBUG
     void CheckForConsistency(bool complete);
@@ -0,0 +1,141 @@
+#include "Batch.h"
+#include "Arena.h"
+#include "BinomialHelper.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <stdexcept>
+
+/* The game of the current thread, reused by each position of the same size, see GameMgr::Reset
+ *
+ * Note: Unlike the one of run(), it is external, and never allocates from the CurrentArena.
+ */
+static thread_local std::optional<GameMgr> Pooled;
+
+static GameMgr &Acquire(int width, int height, int mines, const Strategy &strategy)
+{
+    if (!Pooled || Pooled->GetTotalWidth() != width || Pooled->GetTotalHeight() != height ||
+        Pooled->GetTotalMines() != mines)
+        return Pooled.emplace(width, height, mines, strategy);
+    if (!(Pooled->BasicStrategy == strategy))
+    {
+        Pooled->BasicStrategy = strategy;
+        Pooled->Reset();
+    }
+    return *Pooled;
+}
+
+BatchSolver::BatchSolver(Strategy strategy, std::shared_ptr<ThreadPool> pool) : m_Strategy(std::move(strategy)), m_Pool(std::move(pool)) { }
+
+std::pair<size_t, size_t> BatchSolver::Measure(std::span<const int> input)
+{
+    size_t positions = 0, cells = 0;
+    for (size_t i = 0; i < input.size(); ++positions)
+    {
+        if (input.size() - i < 3)
+            throw std::runtime_error("batch position header is truncated");
+        auto width = input[i], height = input[i + 1], mines = input[i + 2];
+        if (width <= 0 || height <= 0 || mines < -1 || mines > width * height)
+            throw std::runtime_error("batch position has an invalid size");
+        i += 3;
+        if (input.size() - i < size_t(width) * height)
+            throw std::runtime_error("batch position cells are truncated");
+        for (auto j = 0; j < width * height; ++j)
+            if (input[i + j] < BatchMine || input[i + j] > 8)
+                throw std::runtime_error("batch position has an invalid cell");
+        i += size_t(width) * height;
+        cells += size_t(width) * height;
+    }
+    return { positions, cells };
+}
+
+void BatchSolver::Solve(std::span<const int> input, std::span<double> probabilities, std::span<int> best)
+{
+    auto [positions, cells] = Measure(input);
+    if (probabilities.size() != cells || best.size() != positions)
+        throw std::runtime_error("batch outputs mismatch the input");
+
+    auto &offsets = m_Offsets_Temp;
+    offsets.clear();
+    offsets.reserve(positions);
+    auto maxN = 0, maxM = 0;
+    for (size_t i = 0, o = 0; i < input.size();)
+    {
+        offsets.emplace_back(i, o);
+        auto n = input[i] * input[i + 1];
+        maxN = MAX(maxN, n);
+        maxM = MAX(maxM, input[i + 2]);
+        i += 3 + n, o += n;
+    }
+    // the workers then only take the shared lock of the table
+    CacheBinomials(maxN, maxM);
+
+    auto fun = [&](size_t p)
+        {
+            auto [i, o] = offsets[p];
+            SolvePosition(&input[i], &probabilities[o], best[p]);
+        };
+    if (m_Pool)
+        m_Pool->ParallelFor(positions, fun);
+    else
+        for (size_t p = 0; p < positions; ++p)
+            fun(p);
+}
+
+void BatchSolver::SolvePosition(const int *position, double *probabilities, int &best) const
+{
+    // the pooled game outlives any arena of the calling thread
+    struct ArenaGuard
+    {
+        GameArena *Saved = std::exchange(CurrentArena, nullptr);
+        ~ArenaGuard() { CurrentArena = Saved; }
+    } guard;
+
+    auto width = position[0], height = position[1], mines = position[2];
+    auto cells = position + 3;
+    auto &mgr = Acquire(width, height, mines, m_Strategy);
+    auto n = width * height;
+    try
+    {
+        // mines first, so that a degree never finds its neighbors already decided otherwise
+        for (auto id = 0; id < n; ++id)
+            if (cells[id] == BatchMine)
+                (void)mgr.SetBlockMine(id, true);
+        for (auto id = 0; id < n; ++id)
+            if (cells[id] >= 0)
+                (void)mgr.SetBlockDegree(id, cells[id]);
+        mgr.Solve(SolvingState::Reduce | SolvingState::Overlap | SolvingState::Probability | SolvingState::Heuristic, false);
+    }
+    catch (const std::runtime_error &)
+    {
+        // Infeasible, or degrees contradicting the mines
+        Pooled.reset();
+        std::fill(probabilities, probabilities + n, NAN);
+        best = -1;
+        return;
+    }
+    catch (...)
+    {
+        Pooled.reset();
+        throw;
+    }
+
+    if (!mgr.GetStarted())
+    {
+        std::fill(probabilities, probabilities + n, NAN);
+        best = -1;
+    }
+    else
+    {
+        for (auto id = 0; id < n; ++id)
+            probabilities[id] = mgr.GetBlockProbability(id);
+        if (mgr.GetBestBlockCount() > 0)
+            best = mgr.GetBestBlocks()[0];
+        else if (mgr.GetPreferredBlockCount() > 0)
+            best = mgr.GetPreferredBlocks()[0];
+        else
+            best = -1;
+    }
+    mgr.Reset();
+}
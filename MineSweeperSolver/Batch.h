@@ -0,0 +1,51 @@
+#pragma once
+#include "stdafx.h"
+#include "GameMgr.h"
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+/* Cells of a position in a batch, besides degrees 0..8 */
+constexpr int BatchUnknown = -1;
+constexpr int BatchMine = -2;
+
+/* Probabilities and best blocks of many independent positions at once,
+ * each solved as an external game, see GameMgr(int, int, int, Strategy)
+ *
+ * Positions lie one after another in a flat buffer of ints:
+ *   width, height, total mines (-1 if unknown),
+ *   then width * height cells in the order of block ids (x * height + y),
+ *   each a degree, BatchUnknown or BatchMine.
+ *
+ * Note: Each thread keeps its last GameMgr to solve the next position of the same size, see GameMgr::Reset.
+ * Note: Binomials up to the largest position are cached before solving.
+ */
+class
+    BatchSolver
+{
+public:
+    /* <pool> may be nullptr to solve the positions one by one on the calling thread */
+    BatchSolver(Strategy strategy, std::shared_ptr<ThreadPool> pool);
+
+    /* Number of positions in <input> and of cells among them, i.e. the sizes of the outputs of Solve */
+    [[nodiscard]] static std::pair<size_t, size_t> Measure(std::span<const int> input);
+
+    /* Solve every position of <input> into buffers sized as by Measure:
+     * <probabilities> gets the mine probability of each cell, in the order of the cells of <input>;
+     * <best> gets one block to open for each position: a sure blank if any, else the preferred one,
+     * or -1 if nothing is left to open.
+     *
+     * Note: Inconsistent positions get NAN probabilities and -1; they do not fail the others.
+     * Note: Malformed input or outputs of the wrong size throw before anything is solved.
+     * Note: Concurrent calls sharing the pool are run one after another, see ThreadPool::ParallelFor.
+     */
+    void Solve(std::span<const int> input, std::span<double> probabilities, std::span<int> best);
+
+private:
+    Strategy m_Strategy;
+    std::shared_ptr<ThreadPool> m_Pool;
+    std::vector<std::pair<size_t, size_t>> m_Offsets_Temp; // of each position in the input and in the output
+
+    void SolvePosition(const int *position, double *probabilities, int &best) const;
+};
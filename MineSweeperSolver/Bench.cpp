@@ -0,0 +1,531 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <unistd.h>
+
+#include "Batch.h"
+#include "facade.hpp"
+#include "GameMgr.h"
+#include "Profile.h"
+#include "random.h"
+#include "ThreadPool.h"
+
+static constexpr auto LOGIC = SolvingState::Reduce | SolvingState::Overlap | SolvingState::Probability;
+
+
+// positions to benchmark on, each saved by GameMgr::Save
+struct suite {
+    std::string board;
+    std::string string;
+    Configuration cfg;
+    std::vector<std::string> positions;
+};
+
+// the fastest of all repeats, in total
+struct sample {
+    uint64_t ns = UINT64_MAX;
+    uint64_t calls = 0;
+
+    void keep(uint64_t n, uint64_t c) {
+        if (n < ns)
+            ns = n, calls = c;
+    }
+};
+
+static auto g_repeat = 3;
+static auto g_drain = 1000.0; // positions with more solutions are not drained, as in -D<D>
+static constexpr std::chrono::steady_clock::duration g_drain_budget = std::chrono::seconds{ 1 };
+
+auto now() {
+    return std::chrono::steady_clock::now();
+}
+
+uint64_t nanos(std::chrono::steady_clock::time_point begin) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now() - begin).count();
+}
+
+GameMgr load(const suite &s, const std::string &pos) {
+    std::istringstream ss{ pos };
+    return GameMgr{ ss, s.cfg };
+}
+
+// positions where a guess is needed, from games of fixed seeds 1..<games>
+std::vector<std::string> generate(const Configuration &cfg, int games, size_t cap) {
+    std::vector<std::string> positions;
+    for (auto seed = 1; seed <= games && positions.size() < cap; seed++) {
+        SeedEngine(seed);
+        GameMgr mgr{ cfg.Width, cfg.Height, cfg.TotalMines, cfg.IsSNR, cfg };
+        mgr.AutomaticStep(LOGIC | SolvingState::Heuristic); // the initial position
+        while (positions.size() < cap && mgr.SemiAutomatic(LOGIC)) {
+            std::ostringstream ss;
+            mgr.Save(ss);
+            positions.push_back(std::move(ss).str());
+            mgr.AutomaticStep(LOGIC | SolvingState::Heuristic);
+        }
+    }
+    return positions;
+}
+
+// header of a position saved by MineSweeperSolver -r is skipped, see record in main.cpp
+void add_recorded(std::vector<suite> &suites, const std::filesystem::path &path) {
+    std::ifstream fin{ path, std::ios::binary };
+    std::string line, string;
+    std::getline(fin, line);
+    std::istringstream{ line } >> string;
+    if (!fin || string.empty())
+        throw std::runtime_error(path.string() + ": malformed position");
+    auto it = std::find_if(suites.begin(), suites.end(), [&](const suite &s) {
+        return s.board == "recorded" && s.string == string;
+    });
+    if (it == suites.end()) {
+        it = suites.insert(suites.end(), { "recorded", string, parse(string.c_str()), {} });
+        cache(it->cfg);
+    }
+    it->positions.emplace_back(std::istreambuf_iterator<char>{ fin }, std::istreambuf_iterator<char>{});
+}
+
+void emit(const suite &s, const char *kernel, const sample &smp, size_t positions) {
+    nlohmann::json j;
+    j["board"] = s.board;
+    j["string"] = s.string;
+    j["kernel"] = kernel;
+    j["positions"] = positions;
+    j["calls"] = smp.calls;
+    j["ns"] = smp.ns;
+    j["ns-per-call"] = smp.calls ? static_cast<double>(smp.ns) / static_cast<double>(smp.calls) : 0.0;
+    std::cout << j << std::endl;
+}
+
+void emit(const suite &s, const char *kernel, const sample &smp) {
+    emit(s, kernel, smp, s.positions.size());
+}
+
+// GameMgr::SettleMines, by the first move of the games that produced the positions
+void bench_settle(const suite &s) {
+    sample smp;
+    PhaseProfile profile;
+    for (auto r = 0; r < g_repeat; r++) {
+        profile.Clear();
+        for (auto i = 0z; i < s.positions.size(); i++) {
+            SeedEngine(i + 1);
+            GameMgr mgr{ s.cfg.Width, s.cfg.Height, s.cfg.TotalMines, s.cfg.IsSNR, s.cfg };
+            CurrentProfile = &profile;
+            mgr.OpenBlock(s.cfg.Index / s.cfg.Height, s.cfg.Index % s.cfg.Height);
+            CurrentProfile = nullptr;
+        }
+        smp.keep(profile.Nanos[static_cast<size_t>(Phase::Generate)], profile.Calls[static_cast<size_t>(Phase::Generate)]);
+    }
+    emit(s, "settle-mines", smp);
+}
+
+// BasicSolver::AddRestrain, replaying GameMgr::RestoreRestrains
+void bench_add_restrain(const suite &s) {
+    auto topology = BoardTopology::Of(s.cfg.Width, s.cfg.Height);
+    std::vector<std::vector<BlockProperty>> boards;
+    for (auto &pos : s.positions) {
+        auto mgr = load(s, pos);
+        auto &props = boards.emplace_back();
+        for (auto x = 0; x < s.cfg.Width; x++)
+            for (auto y = 0; y < s.cfg.Height; y++)
+                if (auto prop = mgr.GetBlockProperty(x, y); prop.IsOpen)
+                    props.push_back(prop);
+    }
+    sample smp;
+    for (auto r = 0; r < g_repeat; r++) {
+        uint64_t ns = 0, calls = 0;
+        for (auto &props : boards) {
+            Solver solver(s.cfg.Width * s.cfg.Height, s.cfg.TotalMines);
+            auto begin = now();
+            for (auto &prop : props)
+                solver.AddRestrain(prop.Index, prop.IsMine);
+            for (auto &prop : props)
+                if (!prop.IsMine && prop.Degree >= 0)
+                    solver.AddRestrain(topology->BlocksR[prop.Index], prop.Degree);
+            ns += nanos(begin);
+            calls += props.size();
+        }
+        smp.keep(ns, calls);
+    }
+    emit(s, "add-restrain", smp);
+}
+
+// BasicSolver::ReduceRestrains, SimpleOverlapAll, Gauss, EnumerateSolutions and ProcessSolutions, by PhaseTimer
+void bench_solve(const suite &s, const std::vector<Solver> &bases) {
+    static constexpr std::pair<Phase, const char *> PHASES[]{
+        { Phase::Reduce, "reduce-restrains" },
+        { Phase::Overlap, "simple-overlap-all" },
+        { Phase::Gauss, "gauss" },
+        { Phase::Enumerate, "enumerate-solutions" },
+        { Phase::Process, "process-solutions" },
+    };
+    sample smps[std::size(PHASES)];
+    PhaseProfile profile;
+    for (auto r = 0; r < g_repeat; r++) {
+        profile.Clear();
+        for (auto &base : bases) {
+            Solver solver{ base };
+            CurrentProfile = &profile;
+            (void)solver.TrySolve(LOGIC, false);
+            CurrentProfile = nullptr;
+        }
+        for (auto i = 0z; i < std::size(PHASES); i++)
+            smps[i].keep(profile.Nanos[static_cast<size_t>(PHASES[i].first)],
+                         profile.Calls[static_cast<size_t>(PHASES[i].first)]);
+    }
+    for (auto i = 0z; i < std::size(PHASES); i++)
+        emit(s, PHASES[i].second, smps[i]);
+}
+
+// Solver::*CondQ of every unknown block, with a cold cache
+template <typename F>
+void bench_heuristic(const suite &s, const std::vector<Solver> &solved, const char *kernel, F fn) {
+    auto topology = BoardTopology::Of(s.cfg.Width, s.cfg.Height);
+    sample smp;
+    for (auto r = 0; r < g_repeat; r++) {
+        uint64_t ns = 0, calls = 0;
+        for (auto &base : solved) {
+            Solver solver{ base };
+            auto begin = now();
+            for (Block blk = 0; blk < s.cfg.Width * s.cfg.Height; blk++)
+                if (solver.GetBlockStatus(blk) == BlockStatus::Unknown)
+                    fn(solver, topology->BlocksR[blk], blk), calls++;
+            ns += nanos(begin);
+        }
+        smp.keep(ns, calls);
+    }
+    emit(s, kernel, smp);
+}
+
+// Drainer::Drainer (GenerateMicros and GenerateRoot), and the MakeProgress steps
+void bench_drainer(const suite &s) {
+    // few solutions do not imply few macro situations, so leave out what fails to drain in time
+    std::vector<std::string> drainable;
+    for (auto &pos : s.positions) {
+        auto mgr = load(s, pos);
+        mgr.Solve(LOGIC, false);
+        if (mgr.GetSolver().GetTotalStates() > g_drain)
+            continue;
+        mgr.SetDeadline(Deadline{ g_drain_budget });
+        mgr.EnableDrainer(true);
+        if (!mgr.GetDegraded())
+            drainable.push_back(pos);
+    }
+    sample generate, progress;
+    for (auto r = 0; r < g_repeat; r++) {
+        uint64_t gen_ns = 0, gen_calls = 0, prog_ns = 0, prog_calls = 0;
+        for (auto &pos : drainable) {
+            auto mgr = load(s, pos);
+            mgr.Solve(LOGIC, false);
+            auto begin = now();
+            mgr.EnableDrainer(false);
+            gen_ns += nanos(begin), gen_calls++;
+            begin = now();
+            while (mgr.MakeDrainerProgress())
+                prog_calls++;
+            prog_ns += nanos(begin);
+        }
+        generate.keep(gen_ns, gen_calls);
+        progress.keep(prog_ns, prog_calls);
+    }
+    emit(s, "generate-micros", generate, drainable.size());
+    emit(s, "make-progress", progress, drainable.size());
+}
+
+// GameMgr::Save and GameMgr(std::istream &, Strategy), and the compact alternatives
+void bench_snapshot(const suite &s) {
+    std::vector<GameMgr> games;
+    std::vector<std::string> deflated;
+    for (auto &pos : s.positions)
+        deflated.push_back(games.emplace_back(load(s, pos)).Deflate());
+    sample save, restore, deflate, inflate;
+    for (auto r = 0; r < g_repeat; r++) {
+        uint64_t ns[4]{};
+        for (auto i = 0z; i < games.size(); i++) {
+            std::ostringstream os;
+            auto begin = now();
+            games[i].Save(os);
+            ns[0] += nanos(begin);
+
+            std::istringstream is{ s.positions[i] };
+            begin = now();
+            GameMgr loaded{ is, s.cfg };
+            ns[1] += nanos(begin);
+
+            begin = now();
+            auto snap = games[i].Deflate();
+            ns[2] += nanos(begin);
+
+            begin = now();
+            GameMgr inflated{ std::string_view{ deflated[i] }, s.cfg };
+            ns[3] += nanos(begin);
+        }
+        save.keep(ns[0], games.size());
+        restore.keep(ns[1], games.size());
+        deflate.keep(ns[2], games.size());
+        inflate.keep(ns[3], games.size());
+    }
+    emit(s, "save", save);
+    emit(s, "load", restore);
+    emit(s, "deflate", deflate);
+    emit(s, "inflate", inflate);
+}
+
+// a position of <mgr> as BatchSolver takes it, with the mines the solver knows on every other one
+void append_batch(std::vector<int> &input, const suite &s, const GameMgr &mgr, bool mines) {
+    input.insert(input.end(), { s.cfg.Width, s.cfg.Height, s.cfg.TotalMines });
+    for (auto x = 0; x < s.cfg.Width; x++)
+        for (auto y = 0; y < s.cfg.Height; y++) {
+            auto prop = mgr.GetBlockProperty(x, y);
+            if (prop.IsOpen)
+                input.push_back(prop.Degree);
+            else if (mines && mgr.GetSolver().GetBlockStatus(prop.Index) == BlockStatus::Mine)
+                input.push_back(BatchMine);
+            else
+                input.push_back(BatchUnknown);
+        }
+}
+
+// what BatchSolver::Solve gives for one position, by a GameMgr of its own
+void solve_fresh(const Configuration &cfg, const int *position, double *probabilities, int &best) {
+    auto width = position[0], height = position[1], mines = position[2];
+    auto cells = position + 3;
+    GameMgr mgr{ width, height, mines, cfg };
+    try {
+        for (auto id = 0; id < width * height; id++)
+            if (cells[id] == BatchMine)
+                (void)mgr.SetBlockMine(id, true);
+        for (auto id = 0; id < width * height; id++)
+            if (cells[id] >= 0)
+                (void)mgr.SetBlockDegree(id, cells[id]);
+        mgr.Solve(LOGIC | SolvingState::Heuristic, false);
+    } catch (const std::runtime_error &) {
+        std::fill(probabilities, probabilities + width * height, NAN);
+        best = -1;
+        return;
+    }
+    if (!mgr.GetStarted()) {
+        std::fill(probabilities, probabilities + width * height, NAN);
+        best = -1;
+        return;
+    }
+    for (auto id = 0; id < width * height; id++)
+        probabilities[id] = mgr.GetBlockProbability(id);
+    best = mgr.GetBestBlockCount() ? mgr.GetBestBlocks()[0] : mgr.GetPreferredBlockCount() ? mgr.GetPreferredBlocks()[0] : -1;
+}
+
+// BatchSolver::Solve, on the calling thread and on 3 workers, over the positions and as many made inconsistent;
+// both must give what a fresh GameMgr gives for each position, or the run fails
+void bench_batch(const suite &s) {
+    auto n = s.cfg.Width * s.cfg.Height;
+    std::vector<int> input;
+    std::vector<bool> infeasible;
+    for (auto i = 0z; i < s.positions.size(); i++) {
+        auto mgr = load(s, s.positions[i]);
+        mgr.Solve(LOGIC, false);
+        auto first = input.size();
+        append_batch(input, s, mgr, i % 2);
+        infeasible.push_back(false);
+        // an open block on the edge has at most 5 neighbors, so 8 of them cannot be mines
+        for (auto id = 0; id < n; id++) {
+            auto x = id / s.cfg.Height, y = id % s.cfg.Height;
+            if ((x == 0 || y == 0 || x == s.cfg.Width - 1 || y == s.cfg.Height - 1) && input[first + 3 + id] >= 0) {
+                input.insert(input.end(), input.begin() + first, input.begin() + first + 3 + n);
+                input[input.size() - n + id] = 8;
+                infeasible.push_back(true);
+                break;
+            }
+        }
+    }
+    auto [positions, cells] = BatchSolver::Measure(input);
+
+    std::vector<double> expected(cells);
+    std::vector<int> expected_best(positions);
+    for (auto p = 0z; p < positions; p++) {
+        solve_fresh(s.cfg, &input[p * (3 + n)], &expected[p * n], expected_best[p]);
+        if (std::isnan(expected[p * n]) != infeasible[p])
+            throw std::runtime_error(s.board + ": position " + std::to_string(p) + " is not solved as expected");
+    }
+
+    auto check = [&](const char *kernel, const std::shared_ptr<ThreadPool> &pool) {
+        BatchSolver batch{ s.cfg, pool };
+        std::vector<double> probabilities(cells);
+        std::vector<int> best(positions);
+        sample smp;
+        for (auto r = 0; r < g_repeat; r++) {
+            auto begin = now();
+            batch.Solve(input, probabilities, best);
+            smp.keep(nanos(begin), positions);
+            for (auto c = 0z; c < cells; c++)
+                if (!(probabilities[c] == expected[c] || std::isnan(probabilities[c]) && std::isnan(expected[c])))
+                    throw std::runtime_error(s.board + ": " + kernel + " differs from a fresh GameMgr in probabilities");
+            if (best != expected_best)
+                throw std::runtime_error(s.board + ": " + kernel + " differs from a fresh GameMgr in best blocks");
+        }
+        emit(s, kernel, smp, positions);
+    };
+    check("batch-serial", nullptr);
+    check("batch-pool", std::make_shared<ThreadPool>(3));
+}
+
+void bench(const suite &s) {
+    // ties among heuristics are broken randomly
+    SeedEngine(0);
+
+    if (s.board != "recorded")
+        bench_settle(s);
+    bench_add_restrain(s);
+
+    std::vector<Solver> bases, solved;
+    for (auto &pos : s.positions) {
+        auto mgr = load(s, pos);
+        bases.push_back(mgr.GetSolver());
+        mgr.Solve(LOGIC, false);
+        solved.push_back(mgr.GetSolver());
+    }
+    bench_solve(s, bases);
+
+    int min;
+    bench_heuristic(s, solved, "zero-cond-q", [](Solver &solver, const BlockSet &set, Block blk) {
+        (void)solver.ZeroCondQ(set, blk);
+    });
+    bench_heuristic(s, solved, "zeros-cond-q", [](Solver &solver, const BlockSet &set, Block blk) {
+        (void)solver.ZerosCondQ(set, blk);
+    });
+    bench_heuristic(s, solved, "zeros-e-cond-q", [](Solver &solver, const BlockSet &set, Block blk) {
+        (void)solver.ZerosECondQ(set, blk);
+    });
+    bench_heuristic(s, solved, "upper-bound-cond-q", [](Solver &solver, const BlockSet &set, Block blk) {
+        (void)solver.UpperBoundCondQ(set, blk);
+    });
+    bench_heuristic(s, solved, "distribution-cond-q", [&](Solver &solver, const BlockSet &set, Block blk) {
+        (void)solver.DistributionCondQ(set, blk, min);
+    });
+    bench_heuristic(s, solved, "quantity-cond-q", [](Solver &solver, const BlockSet &set, Block blk) {
+        (void)solver.QuantityCondQ(set, blk);
+    });
+
+    if (s.cfg.Logic == LogicMethod::Full)
+        bench_drainer(s);
+    bench_snapshot(s);
+    bench_batch(s);
+}
+
+nlohmann::json build_info() {
+    nlohmann::json j;
+#ifdef __VERSION__
+    j["compiler"] = __VERSION__;
+#endif
+    std::vector<std::string> isa;
+#ifdef __AVX2__
+    isa.push_back("avx2");
+#endif
+#ifdef __AVX512F__
+    isa.push_back("avx512f");
+#endif
+#ifdef __BMI2__
+    isa.push_back("bmi2");
+#endif
+#ifdef __POPCNT__
+    isa.push_back("popcnt");
+#endif
+#ifdef __znver2__
+    isa.push_back("znver2");
+#endif
+    j["isa"] = isa;
+    j["repeat"] = g_repeat;
+    return j;
+}
+
+int main(int argc, char *argv[]) {
+    const auto prog = argv[0];
+    auto usage = [prog] {
+        std::cout << "Usage: " << prog << R"( [-n <repeat>] [-g <games>] [-p <positions>] [-D <D>] [-b <board>]... [<corpus or position>...])"
+                  << "\n  -n: run each kernel <repeat> times and keep the fastest, default 3"
+                  << "\n  -g: play games of seeds 1..<games> on each board for positions, default 64"
+                  << "\n  -p: at most <positions> positions on each board, default 64"
+                  << "\n  -D: time the drainer on positions with at most <D> solutions, default 1000;"
+                  << "\n      positions that take more than 1s to drain are left out"
+                  << "\n  -b: only the given boards: beginner, intermediate, expert, large, none"
+                  << "\nPositions saved by MineSweeperSolver -r are benchmarked as board \"recorded\"."
+                  << "\nOne line per board and kernel, the first line describes the build; times are in ns."
+                  << "\nFails if BatchSolver, serial or pooled, disagrees with a fresh GameMgr on any position."
+                  << std::endl;
+        return 2;
+    };
+
+    static const std::pair<const char *, const char *> BOARDS[]{
+        { "beginner", "FL@[1,1]-PSEQ-9-9-T10-SFAR" },
+        { "intermediate", "FL@[1,1]-PSEQ-16-16-T40-SFAR" },
+        { "expert", "FL@[1,1]-PSEQ-30-16-T99-SFAR" },
+        { "large", "FL@[1,1]-PSEQ-50-50-T500-SFAR" },
+    };
+
+    auto games = 64;
+    size_t cap = 64;
+    std::vector<std::string> boards;
+    for (int opt; (opt = getopt(argc, argv, "n:g:p:D:b:")) != -1;)
+        switch (opt) {
+            case 'n':
+                g_repeat = std::atoi(optarg);
+                if (g_repeat <= 0)
+                    return usage();
+                break;
+            case 'g':
+                games = std::atoi(optarg);
+                if (games <= 0)
+                    return usage();
+                break;
+            case 'p':
+                cap = std::strtoul(optarg, nullptr, 10);
+                break;
+            case 'D':
+                g_drain = std::atof(optarg);
+                break;
+            case 'b':
+                boards.emplace_back(optarg);
+                break;
+            default:
+                return usage();
+        }
+
+    std::vector<suite> suites;
+    for (auto [board, string] : BOARDS)
+        if (boards.empty() || std::find(boards.begin(), boards.end(), board) != boards.end()) {
+            auto &s = suites.emplace_back(board, string, parse(string));
+            cache(s.cfg);
+            s.positions = generate(s.cfg, games, cap);
+        }
+    try {
+        for (auto i = optind; i < argc; i++)
+            if (std::filesystem::is_directory(argv[i])) {
+                std::vector<std::filesystem::path> paths;
+                for (auto &entry : std::filesystem::directory_iterator{ argv[i] })
+                    if (entry.path().extension() == ".mws")
+                        paths.push_back(entry.path());
+                std::sort(paths.begin(), paths.end());
+                for (auto &path : paths)
+                    add_recorded(suites, path);
+            } else {
+                add_recorded(suites, argv[i]);
+            }
+    } catch (std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    std::cout << nlohmann::json{ { "build", build_info() } } << std::endl;
+    try {
+        for (auto &s : suites)
+            if (!s.positions.empty())
+                bench(s);
+    } catch (std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,35 @@
+#include "Profile.h"
+#include <cstdlib>
+#include <new>
+
+/* Count allocations into CurrentProfile
+ *
+ * Note: Linked into MineSweeperSolver only, which reports them under exec.profile;
+ * other binaries keep the default operator new.
+ * Note: The array and nothrow forms forward to these;
+ * aligned allocations are left alone, as nothing here over-aligns.
+ */
+void *operator new(std::size_t size)
+{
+    if (auto p = CurrentProfile)
+        p->Allocations[p->Busy ? static_cast<size_t>(p->Current) : static_cast<size_t>(Phase::Count)]++;
+    for (;;)
+    {
+        if (auto ptr = std::malloc(size ? size : 1))
+            return ptr;
+        auto handler = std::get_new_handler();
+        if (!handler)
+            throw std::bad_alloc{};
+        handler();
+    }
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
@@ -0,0 +1,290 @@
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <pthread.h>
+#include <set>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
+
+#include "daemon.hpp"
+#include "facade.hpp"
+#include "GameMgr.h"
+#include "random.h"
+
+static constexpr auto LOGIC = SolvingState::Reduce | SolvingState::Overlap | SolvingState::Probability;
+
+static std::sig_atomic_t g_exiting = 0;
+
+void sig_handler(int signal) {
+    (void) signal;
+    g_exiting = 1;
+}
+
+// connections being served, to be shut down on exit
+static std::mutex g_sessions_mutex;
+static std::condition_variable g_sessions_done;
+static std::set<int> g_sessions;
+
+// cache() is not thread-safe
+static std::mutex g_cache_mutex;
+
+void warm(const Configuration &cfg) {
+    std::lock_guard lock{ g_cache_mutex };
+    cache(cfg);
+}
+
+// refused before the game is touched, so the session goes on
+struct bad_request : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+Deadline deadline_of(uint32_t us) {
+    if (!us)
+        return Deadline{};
+    return Deadline{ std::chrono::microseconds{ us } };
+}
+
+// the game of one connection; it stays warm between requests:
+// solver state, the drainer and the caches of heuristics
+struct session {
+    std::string string;
+    Configuration cfg;
+    std::optional<GameMgr> mgr;
+    bool pooled = false; // mgr is a game of cfg, not a loaded position
+
+    GameMgr &game() {
+        if (!mgr)
+            throw bad_request("no position loaded");
+        return *mgr;
+    }
+
+    void load(std::string_view &body, std::string &reply) {
+        auto len = get<uint16_t>(body);
+        if (body.size() < len)
+            throw bad_request("frame is truncated");
+        std::string str{ body.substr(0, len) };
+        body.remove_prefix(len);
+        if (str != string || !mgr) {
+            auto parsed = parse(str.c_str());
+            if (parsed.Width < 1 || parsed.Height < 1 || parsed.Width > DAEMON_MAX_BLOCKS / parsed.Height)
+                throw bad_request("board is too large");
+            if (parsed.TotalMines < 0 || parsed.TotalMines >= parsed.Width * parsed.Height)
+                throw bad_request("mines out of range");
+            mgr.reset();
+            cfg = parsed;
+            string = std::move(str);
+            warm(cfg);
+        }
+        if (!body.empty()) {
+            // the binomials are cached for cfg only
+            if (GameMgr::SizeOf(body) != std::tuple{ cfg.Width, cfg.Height, cfg.TotalMines })
+                throw bad_request("position does not match the configuration");
+            pooled = false;
+            mgr.emplace(body, cfg);
+        } else if (mgr && pooled) { // a new game of the same kind
+            mgr->Reset();
+        } else {
+            pooled = true;
+            mgr.emplace(cfg.Width, cfg.Height, cfg.TotalMines, cfg.IsSNR, cfg, false);
+        }
+        put<int32_t>(reply, mgr->GetTotalWidth());
+        put<int32_t>(reply, mgr->GetTotalHeight());
+        put<int32_t>(reply, mgr->GetTotalMines());
+        put<int32_t>(reply, mgr->GetToOpen());
+    }
+
+    void solve(std::string_view &body, std::string &reply) {
+        auto &g = game();
+        auto reached = g.Solve(LOGIC, false, deadline_of(get<uint32_t>(body)));
+        put(reply, static_cast<uint32_t>(reached));
+        for (auto id = 0; id < g.GetTotalWidth() * g.GetTotalHeight(); id++)
+            put(reply, g.GetBlockProbability(id));
+    }
+
+    void click(std::string_view &body, std::string &reply) {
+        auto &g = game();
+        auto id = get<int32_t>(body);
+        if (id < 0 || id >= g.GetTotalWidth() * g.GetTotalHeight())
+            throw bad_request("block out of range");
+        if (!g.GetStarted())
+            throw bad_request("game is over");
+        (void)g.OpenBlock(id / g.GetTotalHeight(), id % g.GetTotalHeight());
+        put<uint8_t>(reply, g.GetStarted());
+        put<uint8_t>(reply, g.GetSucceed());
+        put<int32_t>(reply, g.GetToOpen());
+    }
+
+    // as GameMgr::Automatic would open
+    void best(std::string_view &body, std::string &reply) {
+        auto &g = game();
+        auto budget = get<uint32_t>(body);
+        if (!g.GetStarted()) {
+            put(reply, static_cast<uint32_t>(SolvingState::Stale));
+            put<int32_t>(reply, -1);
+            return;
+        }
+        if (!g.GetSettled() && cfg.InitialPositionSpecified) {
+            put(reply, static_cast<uint32_t>(SolvingState::Stale));
+            put<int32_t>(reply, cfg.Index);
+            return;
+        }
+        auto reached = g.Solve(LOGIC | SolvingState::Heuristic | SolvingState::Drained, false, deadline_of(budget));
+        put(reply, static_cast<uint32_t>(reached));
+        if (g.GetBestBlockCount())
+            put<int32_t>(reply, g.GetBestBlocks()[0]);
+        else if (g.GetPreferredBlockCount())
+            put<int32_t>(reply, g.GetPreferredBlocks()[RandomInteger(g.GetPreferredBlockCount())]);
+        else
+            put<int32_t>(reply, -1);
+    }
+};
+
+void serve(int fd) {
+    SeedEngine();
+    session s;
+    std::string frame;
+    while (read_frame(fd, frame)) {
+        std::string_view body{ frame };
+        auto op = get<daemon_op>(body);
+        auto reply = begin_frame(daemon_status::ok);
+        try {
+            switch (op) {
+                case daemon_op::load:
+                    s.load(body, reply);
+                    break;
+                case daemon_op::solve:
+                    s.solve(body, reply);
+                    break;
+                case daemon_op::click:
+                    s.click(body, reply);
+                    break;
+                case daemon_op::best:
+                    s.best(body, reply);
+                    break;
+                default:
+                    throw bad_request("unknown request");
+            }
+        } catch (const bad_request &e) {
+            reply = begin_frame(daemon_status::error);
+            reply += e.what();
+        } catch (const std::exception &e) {
+            // the game may be half updated
+            s.mgr.reset();
+            reply = begin_frame(daemon_status::error);
+            reply += e.what();
+        }
+        if (!write_frame(fd, reply))
+            break;
+    }
+    std::lock_guard lock{ g_sessions_mutex };
+    g_sessions.erase(fd);
+    close(fd);
+    g_sessions_done.notify_all();
+}
+
+int main(int argc, char *argv[]) {
+    const auto prog = argv[0];
+    auto usage = [prog] {
+        std::cout << "Usage: " << prog << R"( [-s <socket>] [-m <sessions>] [-w <config>]...)"
+                  << "\n  -s: listen on the Unix domain socket <socket>, default mws.sock"
+                  << "\n  -m: serve at most <sessions> connections at once, default 64; more are refused"
+                  << "\n  -w: cache binomials for <config> before listening"
+                  << "\nEach connection is a session of its own thread; see daemon.hpp for the protocol."
+                  << "\nOn SIGINT or SIGTERM, removes <socket> and exits once the requests at hand are answered."
+                  << std::endl;
+        return 2;
+    };
+
+    std::string path = "mws.sock";
+    size_t max_sessions = 64;
+    for (int opt; (opt = getopt(argc, argv, "s:m:w:")) != -1;)
+        switch (opt) {
+            case 's':
+                path = optarg;
+                break;
+            case 'm':
+                max_sessions = std::strtoul(optarg, nullptr, 10);
+                if (!max_sessions)
+                    return usage();
+                break;
+            case 'w':
+                warm(parse(optarg));
+                break;
+            default:
+                return usage();
+        }
+    if (optind != argc)
+        return usage();
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        return usage();
+    std::strcpy(addr.sun_path, path.c_str());
+
+    auto srv = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (srv < 0) {
+        perror("socket");
+        return 1;
+    }
+    unlink(path.c_str());
+    if (bind(srv, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || listen(srv, SOMAXCONN) < 0) {
+        perror(path.c_str());
+        return 1;
+    }
+
+    // no SA_RESTART, so that accept() is interrupted
+    struct sigaction sa = {};
+    sa.sa_handler = &sig_handler;
+    sa.sa_flags = 0;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    std::cerr << "Listening on " << path << std::endl;
+    while (!g_exiting) {
+        auto fd = accept(srv, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno != EINTR)
+                perror("accept");
+            continue;
+        }
+        {
+            std::lock_guard lock{ g_sessions_mutex };
+            if (g_sessions.size() >= max_sessions) {
+                // the peer gets the answer to its first request
+                auto reply = begin_frame(daemon_status::error);
+                reply += "too many sessions";
+                write_frame(fd, reply);
+                close(fd);
+                continue;
+            }
+            g_sessions.insert(fd);
+        }
+        // signals are left to the main thread, to interrupt accept()
+        sigset_t set, old;
+        sigemptyset(&set);
+        sigaddset(&set, SIGINT);
+        sigaddset(&set, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &set, &old);
+        std::thread{ serve, fd }.detach();
+        pthread_sigmask(SIG_SETMASK, &old, nullptr);
+    }
+    close(srv);
+    unlink(path.c_str());
+
+    // each session finishes its request at hand, then finds the connection closed
+    std::unique_lock lock{ g_sessions_mutex };
+    for (auto fd : g_sessions)
+        shutdown(fd, SHUT_RDWR);
+    g_sessions_done.wait(lock, [] { return g_sessions.empty(); });
+    return 0;
+}
@@ -1,7 +1,9 @@
 #include "Drainer.h"
+#include "Profile.h"
 
 Drainer::Drainer(const GameMgr &mgr) : m_Mgr(mgr)
 {
+    m_Deadline = m_Mgr.m_Deadline;
     for (auto i = 0; i < m_Mgr.m_Blocks.size(); ++i)
     {
         if (m_Mgr.m_Blocks[i].IsOpen || m_Mgr.m_Solver->GetBlockStatus(i) != BlockStatus::Unknown)
@@ -13,7 +15,7 @@ Drainer::Drainer(const GameMgr &mgr) : m_Mgr(mgr)
     m_DMines.resize(m_Blocks.size(), 0);
     for (auto i = 0; i < m_Blocks.size(); ++i)
     {
-        for (auto blk : m_Mgr.m_BlocksR[m_Blocks[i]])
+        for (auto blk : m_Mgr.m_Topology->BlocksR[m_Blocks[i]])
             switch (m_Mgr.m_Solver->GetBlockStatus(blk))
             {
             case BlockStatus::Unknown:
@@ -83,6 +85,7 @@ const std::vector<double> &Drainer::GetBestProbabilityList() const
 
 void Drainer::Update()
 {
+    PhaseTimer pt{ Phase::Drain };
     auto macro = new MacroSituation();
     macro->m_Degrees = m_RootMacro->m_Degrees;
     for (auto i = 0; i < m_Blocks.size(); ++i)
@@ -119,9 +122,9 @@ void Drainer::Update()
 
 int Drainer::FrontierDist(const MacroSituation *macro, Block blk) const
 {
-    auto &bt = m_Mgr.m_Blocks[blk];
+    auto &bt = m_Mgr.m_Topology->Blocks[blk];
     auto d = MAX(m_Mgr.m_TotalWidth, m_Mgr.m_TotalHeight);
-    for (auto b : m_Mgr.m_Blocks)
+    for (auto &b : m_Mgr.m_Topology->Blocks)
     {
         if (macro->m_Degrees[b.Index] < 0)
             continue;
@@ -1,12 +1,34 @@
 #include "GameMgr.h"
+#include "Arena.h"
 #include "Strategies.h"
 #include "random.h"
 #include "BinomialHelper.h"
 #include "Drainer.h"
+#include "Profile.h"
+#include "Snapshot.h"
+#include "ThreadPool.h"
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <utility>
 
-GameMgr::GameMgr(int width, int height, int totalMines, bool isSNR, Strategy strategy, bool allowWrongGuess) : BasicStrategy(std::move(strategy)), m_IsExternal(false), m_AllowWrongGuess(allowWrongGuess), m_TotalWidth(width), m_TotalHeight(height), m_TotalMines(totalMines), m_IsSNR(isSNR), m_Settled(false), m_Started(true), m_Succeed(false), m_ToOpen(width * height - totalMines), m_WrongGuesses(0), m_Solver{}, m_Drainer{}, m_LastProbe(-1)
+// layout of GameMgr::Deflate
+#define SNAP_VERSION static_cast<uint8_t>(1)
+#define SNAP_EXTERNAL 0x01
+#define SNAP_ALLOW_WRONG_GUESS 0x02
+#define SNAP_SNR 0x04
+#define SNAP_SETTLED 0x08
+#define SNAP_STARTED 0x10
+#define SNAP_SUCCEED 0x20
+#define SNAP_SOLVER 0x40
+// layout of each block in GameMgr::Deflate
+#define SNAP_DEGREE 0x0f // Degree + 1
+#define SNAP_MAX_SIDE 0x4000 // keeps width * height within an int
+#define SNAP_OPEN 0x10
+#define SNAP_MINE 0x20
+#define SNAP_RELEVANT2 0x40
+
+GameMgr::GameMgr(int width, int height, int totalMines, bool isSNR, Strategy strategy, bool allowWrongGuess) : BasicStrategy(std::move(strategy)), m_IsExternal(false), m_AllowWrongGuess(allowWrongGuess), m_TotalWidth(width), m_TotalHeight(height), m_TotalMines(totalMines), m_IsSNR(isSNR), m_Settled(false), m_Started(true), m_Succeed(false), m_ToOpen(width * height - totalMines), m_WrongGuesses(0), m_Solver{}, m_Drainer{}, m_LastProbe(-1), m_Degraded(false)
 {
     if (BasicStrategy.Logic == LogicMethod::Single || BasicStrategy.Logic == LogicMethod::Double)
         m_Solver.emplace(m_TotalWidth * m_TotalHeight);
@@ -16,7 +38,7 @@ GameMgr::GameMgr(int width, int height, int totalMines, bool isSNR, Strategy str
     m_AllBits = log2(Binomial(m_TotalWidth * m_TotalHeight, m_TotalMines));
 }
 
-GameMgr::GameMgr(int width, int height, int totalMines, Strategy strategy) : BasicStrategy(std::move(strategy)), m_IsExternal(true), m_AllowWrongGuess(false), m_TotalWidth(width), m_TotalHeight(height), m_TotalMines(totalMines), m_IsSNR(false), m_Settled(true), m_Started(true), m_Succeed(false), m_ToOpen(-1), m_WrongGuesses(0), m_Solver{}, m_Drainer{}, m_LastProbe(-1)
+GameMgr::GameMgr(int width, int height, int totalMines, Strategy strategy) : BasicStrategy(std::move(strategy)), m_IsExternal(true), m_AllowWrongGuess(false), m_TotalWidth(width), m_TotalHeight(height), m_TotalMines(totalMines), m_IsSNR(false), m_Settled(true), m_Started(true), m_Succeed(false), m_ToOpen(-1), m_WrongGuesses(0), m_Solver{}, m_Drainer{}, m_LastProbe(-1), m_Degraded(false)
 {
     if (BasicStrategy.Logic == LogicMethod::Single || BasicStrategy.Logic == LogicMethod::Double || m_TotalMines == -1)
         m_Solver.emplace(m_TotalWidth * m_TotalHeight);
@@ -29,7 +51,7 @@ GameMgr::GameMgr(int width, int height, int totalMines, Strategy strategy) : Bas
         m_AllBits = log2(Binomial(m_TotalWidth * m_TotalHeight, m_TotalMines));
 }
 
-GameMgr::GameMgr(std::istream &sr, Strategy strategy) : BasicStrategy(std::move(strategy)), m_IsExternal(false), m_AllowWrongGuess(false), m_TotalWidth(0), m_TotalHeight(0), m_TotalMines(0), m_IsSNR(false), m_Settled(false), m_Started(true), m_Succeed(false), m_ToOpen(0), m_WrongGuesses(0), m_Solver{}, m_Drainer{}, m_LastProbe(0)
+GameMgr::GameMgr(std::istream &sr, Strategy strategy) : BasicStrategy(std::move(strategy)), m_IsExternal(false), m_AllowWrongGuess(false), m_TotalWidth(0), m_TotalHeight(0), m_TotalMines(0), m_IsSNR(false), m_Settled(false), m_Started(true), m_Succeed(false), m_ToOpen(0), m_WrongGuesses(0), m_Solver{}, m_Drainer{}, m_LastProbe(0), m_Degraded(false)
 {
 #define READ(val) sr.read(reinterpret_cast<char *>(&(val)), sizeof(val))
     READ(m_IsExternal);
@@ -58,16 +80,12 @@ GameMgr::GameMgr(std::istream &sr, Strategy strategy) : BasicStrategy(std::move(
             READ(blk.Degree);
             READ(blk.IsOpen);
             READ(blk.IsMine);
-            if (blk.IsOpen)
-                m_Solver->AddRestrain(blk.Index, blk.IsMine);
         }
 
-        for (auto &blk : m_Blocks)
-            if (blk.IsOpen && !blk.IsMine && blk.Degree >= 0)
-            {
-                m_Solver->AddRestrain(m_BlocksR[blk.Index], blk.Degree);
-                UpdateRelevant2Info(blk.Index);
-            }
+        RestoreRestrains();
+        for (auto i = 0; i < m_Blocks.size(); ++i)
+            if (m_Blocks[i].IsOpen && !m_Blocks[i].IsMine && m_Blocks[i].Degree >= 0)
+                UpdateRelevant2Info(i);
     }
 
     CacheBinomials(m_TotalWidth * m_TotalHeight, m_TotalMines);
@@ -77,6 +95,105 @@ GameMgr::GameMgr(std::istream &sr, Strategy strategy) : BasicStrategy(std::move(
         m_AllBits = log2(Binomial(m_TotalWidth * m_TotalHeight, m_TotalMines));
 }
 
+GameMgr::GameMgr(std::string_view snapshot, Strategy strategy) : BasicStrategy(std::move(strategy)), m_IsExternal(false), m_AllowWrongGuess(false), m_TotalWidth(0), m_TotalHeight(0), m_TotalMines(0), m_IsSNR(false), m_Settled(false), m_Started(true), m_Succeed(false), m_ToOpen(0), m_WrongGuesses(0), m_Solver{}, m_Drainer{}, m_LastProbe(-1), m_Degraded(false)
+{
+    SnapshotReader sr{ snapshot };
+    if (sr.Byte() != SNAP_VERSION)
+        throw std::runtime_error("snapshot version mismatch");
+    auto flags = sr.Byte();
+    m_IsExternal = flags & SNAP_EXTERNAL;
+    m_AllowWrongGuess = flags & SNAP_ALLOW_WRONG_GUESS;
+    m_IsSNR = flags & SNAP_SNR;
+    m_Settled = flags & SNAP_SETTLED;
+    m_Started = flags & SNAP_STARTED;
+    m_Succeed = flags & SNAP_SUCCEED;
+    auto width = sr.Unsigned();
+    auto height = sr.Unsigned();
+    if (width < 1 || height < 1 || width > SNAP_MAX_SIDE || height > SNAP_MAX_SIDE)
+        throw std::runtime_error("snapshot board size out of range");
+    m_TotalWidth = static_cast<int>(width);
+    m_TotalHeight = static_cast<int>(height);
+    auto cells = m_TotalWidth * m_TotalHeight;
+    auto mines = sr.Signed();
+    auto toOpen = sr.Signed();
+    m_WrongGuesses = static_cast<int>(sr.Unsigned());
+    auto lastProbe = sr.Signed();
+    if (mines < -1 || mines > cells || toOpen < -1 || toOpen > cells || lastProbe < -1 || lastProbe >= cells)
+        throw std::runtime_error("snapshot counts out of range");
+    m_TotalMines = static_cast<int>(mines);
+    m_ToOpen = static_cast<int>(toOpen);
+    m_LastProbe = static_cast<int>(lastProbe);
+
+    CacheBinomials(m_TotalWidth * m_TotalHeight, m_TotalMines);
+    if (BasicStrategy.Logic == LogicMethod::Single || BasicStrategy.Logic == LogicMethod::Double || m_TotalMines == -1)
+        m_Solver.emplace(m_TotalWidth * m_TotalHeight);
+    else
+        m_Solver.emplace(m_TotalWidth * m_TotalHeight, m_TotalMines);
+
+    GenerateBlocksR();
+
+    if (m_Settled)
+        for (auto &blk : m_Blocks)
+        {
+            auto v = sr.Byte();
+            if ((v & SNAP_DEGREE) > 9)
+                throw std::runtime_error("snapshot degree out of range");
+            blk.Degree = (v & SNAP_DEGREE) - 1;
+            blk.IsOpen = v & SNAP_OPEN;
+            blk.IsMine = v & SNAP_MINE;
+            blk.IsRelevant2 = v & SNAP_RELEVANT2;
+        }
+
+    for (auto lst : { &m_Best, &m_Preferred })
+    {
+        lst->resize(sr.Count());
+        if (lst->size() > static_cast<size_t>(cells))
+            throw std::runtime_error("snapshot has too many candidates");
+        int64_t last = 0;
+        for (auto &blk : *lst)
+        {
+            last += sr.Signed();
+            if (last < 0 || last >= cells)
+                throw std::runtime_error("snapshot block out of range");
+            blk = static_cast<Block>(last);
+        }
+    }
+
+    if (flags & SNAP_SOLVER)
+        m_Solver->Inflate(sr);
+    else if (m_Settled)
+        RestoreRestrains();
+
+    if (!sr.Done())
+        throw std::runtime_error("snapshot has trailing bytes");
+
+    if (m_TotalMines == -1)
+        m_AllBits = m_TotalWidth * m_TotalHeight;
+    else
+        m_AllBits = log2(Binomial(m_TotalWidth * m_TotalHeight, m_TotalMines));
+}
+
+void GameMgr::Reset()
+{
+    m_Settled = m_IsExternal;
+    m_Started = true;
+    m_Succeed = false;
+    m_ToOpen = m_IsExternal ? -1 : m_TotalWidth * m_TotalHeight - m_TotalMines;
+    m_WrongGuesses = 0;
+    if (BasicStrategy.Logic == LogicMethod::Single || BasicStrategy.Logic == LogicMethod::Double || m_TotalMines == -1)
+        m_Solver->Reset(-1);
+    else
+        m_Solver->Reset(m_TotalMines);
+    std::fill(m_Blocks.begin(), m_Blocks.end(), BlockState{ 0, false, false, false });
+    m_Best.clear();
+    m_Preferred.clear();
+    m_Drainer.reset();
+    m_LastProbe = -1;
+    m_PresetMines.clear();
+    m_Deadline = Deadline{};
+    m_Degraded = false;
+}
+
 Solver &GameMgr::GetSolver()
 {
     return *m_Solver;
@@ -107,6 +224,11 @@ int GameMgr::GetTotalMines() const
     return m_TotalMines;
 }
 
+bool GameMgr::GetSNR() const
+{
+    return m_IsSNR;
+}
+
 int GameMgr::GetToOpen() const
 {
     return m_ToOpen;
@@ -150,12 +272,12 @@ int GameMgr::GetLastProbe() const
 double GameMgr::GetMinProbability() const
 {
     double m = 1;
-    for (auto &blk : m_Blocks)
-        if (m_Solver->GetBlockStatus(blk.Index) == BlockStatus::Unknown)
+    for (auto i = 0; i < m_Blocks.size(); ++i)
+        if (m_Solver->GetBlockStatus(i) == BlockStatus::Unknown)
         {
             auto p = m_Drainer
-                ? m_Drainer->GetBestProbabilityList()[blk.Index]
-                : m_Solver->GetProbability(blk.Index);
+                ? m_Drainer->GetBestProbabilityList()[i]
+                : m_Solver->GetProbability(i);
             m = MIN(m, p);
         }
     return m;
@@ -164,46 +286,58 @@ double GameMgr::GetMinProbability() const
 double GameMgr::GetMaxProbability() const
 {
     double m = 0;
-    for (auto &blk : m_Blocks)
-        if (m_Solver->GetBlockStatus(blk.Index) == BlockStatus::Unknown)
+    for (auto i = 0; i < m_Blocks.size(); ++i)
+        if (m_Solver->GetBlockStatus(i) == BlockStatus::Unknown)
         {
             auto p = m_Drainer
-                ? m_Drainer->GetBestProbabilityList()[blk.Index]
-                : m_Solver->GetProbability(blk.Index);
+                ? m_Drainer->GetBestProbabilityList()[i]
+                : m_Solver->GetProbability(i);
             m = MAX(m, p);
         }
     return m;
 }
 
-const BlockProperty &GameMgr::GetBlockProperty(int x, int y) const
+double GameMgr::GetProbabilityError() const
+{
+    return m_Solver->GetStandardError();
+}
+
+BlockProperty GameMgr::GetBlockProperty(int x, int y) const
+{
+    return PropertyOf(GetIndex(x, y));
+}
+
+BlockProperty GameMgr::PropertyOf(int id) const
 {
-    return m_Blocks[GetIndex(x, y)];
+    auto &c = m_Topology->Blocks[id];
+    auto &b = m_Blocks[id];
+    return { c.Index, c.X, c.Y, b.Degree, b.IsOpen, b.IsMine, b.IsRelevant2 };
 }
 
-const BlockProperty &GameMgr::SetBlockDegree(int x, int y, int degree)
+BlockProperty GameMgr::SetBlockDegree(int x, int y, int degree)
 {
     return SetBlockDegree(GetIndex(x, y), degree);
 }
 
-const BlockProperty &GameMgr::SetBlockDegree(int id, int degree)
+BlockProperty GameMgr::SetBlockDegree(int id, int degree)
 {
     if (!m_IsExternal)
         throw std::runtime_error("only external games can be modified");
     auto &b = m_Blocks[id];
     b.Degree = degree;
     b.IsOpen = true;
-    m_Solver->AddRestrain(m_BlocksR[id], degree);
+    m_Solver->AddRestrain(m_Topology->BlocksR[id], degree);
     m_Solver->AddRestrain(id, false);
     UpdateRelevant2Info(id);
-    return b;
+    return PropertyOf(id);
 }
 
-const BlockProperty &GameMgr::SetBlockMine(int x, int y, bool mined)
+BlockProperty GameMgr::SetBlockMine(int x, int y, bool mined)
 {
     return SetBlockMine(GetIndex(x, y), mined);
 }
 
-const BlockProperty &GameMgr::SetBlockMine(int id, bool mined)
+BlockProperty GameMgr::SetBlockMine(int id, bool mined)
 {
     if (!m_IsExternal)
         throw std::runtime_error("only external games can be modified");
@@ -212,12 +346,7 @@ const BlockProperty &GameMgr::SetBlockMine(int id, bool mined)
     b.IsMine = mined;
     b.Degree = -1;
     m_Solver->AddRestrain(id, mined);
-    return b;
-}
-
-const BlockProperty *GameMgr::GetBlockProperties() const
-{
-    return &*m_Blocks.begin();
+    return PropertyOf(id);
 }
 
 double GameMgr::GetBlockProbability(int x, int y) const
@@ -238,7 +367,7 @@ BlockStatus GameMgr::GetInferredStatus(int x, int y) const
 std::pair<int, int> GameMgr::GetDegreeBounds(int id) const
 {
     auto lb = 0, ub = 0;
-    for (auto b : m_BlocksR[id])
+    for (auto b : m_Topology->BlocksR[id])
         switch (m_Solver->GetBlockStatus(b))
         {
             case BlockStatus::Mine:
@@ -253,6 +382,19 @@ std::pair<int, int> GameMgr::GetDegreeBounds(int id) const
     return { lb, ub };
 }
 
+bool GameMgr::IsDegreeFeasible(int id, int degree)
+{
+    auto [lb, ub] = GetDegreeBounds(id);
+    if (degree < lb || degree > ub)
+        return false;
+    if (m_Solver->GetSolutions().empty())
+        return true;
+
+    int min;
+    auto &dist = m_Solver->DistributionCondQ(m_Topology->BlocksR[id], id, min);
+    return degree - min < dist.size() && dist[degree - min] > 0;
+}
+
 const Block *GameMgr::GetBestBlocks() const
 {
     if (m_Best.empty())
@@ -295,26 +437,125 @@ const std::vector<double> &GameMgr::GetBestProbabilityList() const
     return m_Drainer->GetBestProbabilityList();
 }
 
-void GameMgr::Solve(SolvingState maxDepth, bool shortcut)
+template <typename F>
+void GameMgr::LargestByClass(HeuristicMethod method, const F &fun)
 {
-    if (!m_Started)
+    if (m_Preferred.size() <= 1)
         return;
+    m_Solver->Classify(m_Preferred, m_Topology->BlocksR, m_Classes_Temp);
+    if (m_Pool && m_Pool->GetThreads() > 0)
+    {
+        BlockSet reps;
+        for (auto i = 0; i < m_Preferred.size(); ++i)
+            if (m_Classes_Temp[i] == i)
+                reps.push_back(m_Preferred[i]);
+        m_Solver->Prefetch(reps, m_Topology->BlocksR, method, *m_Pool);
+    }
+    auto &vals = m_Values_Temp;
+    vals.resize(m_Blocks.size());
+    for (auto i = 0; i < m_Preferred.size(); ++i)
+        vals[m_Preferred[i]] = m_Classes_Temp[i] == i ? fun(m_Preferred[i]) : vals[m_Preferred[m_Classes_Temp[i]]];
+    Largest(m_Preferred, [&vals](Block blk) { return vals[blk]; });
+}
 
-    m_Best.clear();
-    m_Preferred.clear();
+double GameMgr::Lookahead(Block blk, const Deadline &deadline)
+{
+    auto &set = m_Topology->BlocksR[blk];
+    int min;
+    auto &dist = m_Solver->DistributionCondQ(set, blk, min);
+    auto [lb, ub] = GetDegreeBounds(blk);
 
-    try
+    // the copies are thrown away right after, so keep their scratch off the arena of the game
+    struct ArenaGuard
     {
-        m_Solver->Solve(maxDepth & (SolvingState::Reduce | SolvingState::Overlap | SolvingState::Probability), shortcut);
+        GameArena *Saved = std::exchange(CurrentArena, nullptr);
+        ~ArenaGuard() { CurrentArena = Saved; }
+    } guard;
+
+    auto prog = 0.0;
+    for (auto d = lb; d <= ub; ++d)
+    {
+        if (d - min < 0 || d - min >= dist.size() || dist[d - min] <= 0)
+            continue;
+        Solver s{ *m_Solver };
+        s.SetDeadline(deadline);
+        s.CanOpenForSure = 0;
+        s.AddRestrain(set, d);
+        s.AddRestrain(blk, false);
+        if (s.TrySolve(SolvingState::Reduce | SolvingState::Overlap | SolvingState::Probability, true) == SolveStatus::Infeasible)
+            continue;
+        if (s.CanOpenForSure > 0 || s.GetTotalStates() == 1)
+            prog += dist[d - min];
     }
-    catch (const Infeasible &)
+    return prog * (1 - m_Solver->GetProbability(blk));
+}
+
+void GameMgr::LargestByLookahead()
+{
+    if (m_Preferred.size() <= 1)
+        return;
+    m_Solver->Classify(m_Preferred, m_Topology->BlocksR, m_Classes_Temp);
+    auto &reps = m_Lookahead_Temp;
+    reps.clear();
+    for (auto i = 0; i < m_Preferred.size(); ++i)
+        if (m_Classes_Temp[i] == i)
+            reps.push_back(i);
+    // the safest first, so that running out of budget only drops the least promising
+    std::stable_sort(reps.begin(), reps.end(), [this](size_t lhs, size_t rhs) {
+        return m_Solver->GetProbability(m_Preferred[lhs]) < m_Solver->GetProbability(m_Preferred[rhs]);
+    });
+    if (reps.size() > LookaheadCandidates)
+        reps.resize(LookaheadCandidates);
+
+    auto budget = m_Deadline.Within(LookaheadBudget);
+    auto &vals = m_Values_Temp;
+    vals.resize(m_Blocks.size());
+    for (auto blk : m_Preferred)
+        vals[blk] = -1;
+    auto evaluated = false;
+    for (auto i : reps)
     {
-        if (m_IsExternal)
+        if (m_Deadline.Expired())
         {
-            m_Started = false;
-            return;
+            m_Degraded = true;
+            break;
         }
-        throw;
+        if (budget.Expired())
+            break;
+        auto v = Lookahead(m_Preferred[i], budget);
+        // cut short, so not comparable with the others
+        if (budget.Expired())
+        {
+            if (m_Deadline.Expired())
+                m_Degraded = true;
+            break;
+        }
+        vals[m_Preferred[i]] = v;
+        evaluated = true;
+    }
+    if (!evaluated)
+        return;
+    for (auto i = 0; i < m_Preferred.size(); ++i)
+        vals[m_Preferred[i]] = vals[m_Preferred[m_Classes_Temp[i]]];
+    Largest(m_Preferred, [&vals](Block blk) { return vals[blk]; });
+}
+
+void GameMgr::Solve(SolvingState maxDepth, bool shortcut)
+{
+    if (!m_Started)
+        return;
+
+    SolveRecording rec{ *this, maxDepth, shortcut };
+
+    m_Best.clear();
+    m_Preferred.clear();
+
+    if (m_Solver->TrySolve(maxDepth & (SolvingState::Reduce | SolvingState::Overlap | SolvingState::Probability), shortcut) == SolveStatus::Infeasible)
+    {
+        if (!m_IsExternal)
+            throw Infeasible{};
+        m_Started = false;
+        return;
     }
     if (m_IsExternal && (
         m_Solver->GetTotalStates() == 0))
@@ -370,12 +611,18 @@ void GameMgr::Solve(SolvingState maxDepth, bool shortcut)
         (maxDepth & SolvingState::Drained) == SolvingState::Stale)
         return;
 
-    if ((maxDepth & SolvingState::Drained) == SolvingState::Drained && BasicStrategy.ExhaustEnabled)
-        if (!m_Drainer && m_Solver->GetTotalStates() <= (BasicStrategy.PruningEnabled ? BasicStrategy.PruningCriterion : BasicStrategy.ExhaustCriterion) &&
-            (m_Solver->GetTotalStates() > 2 || m_ToOpen > 1))
+    if ((maxDepth & SolvingState::Drained) == SolvingState::Drained)
+        if (!m_Drainer && WouldDrain())
         {
-            EnableDrainer(true);
-            return;
+            if (m_Deadline.Expired())
+                m_Degraded = true;
+            else
+            {
+                EnableDrainer(true);
+                if (m_Drainer)
+                    return;
+                // abandoned, see EnableDrainer
+            }
         }
 
     if (m_Drainer)
@@ -391,6 +638,7 @@ void GameMgr::Solve(SolvingState maxDepth, bool shortcut)
     if (!BasicStrategy.HeuristicEnabled)
         return;
 
+    std::optional<PhaseTimer> pt{ std::in_place, Phase::Heuristic };
     if (m_Preferred.empty())
         for (auto i = 0; i < m_Blocks.size(); ++i)
         {
@@ -400,37 +648,97 @@ void GameMgr::Solve(SolvingState maxDepth, bool shortcut)
         }
 
 #define LARGEST(exp) Largest(m_Preferred, [this](Block blk) { return exp; } )
+    // for those that only depend on the sets of the block and of its neighbors
+#define LARGEST_CLASS(exp) LargestByClass(heu, [this](Block blk) { return exp; } )
+
+    // no solutions to condition on: out of time, or out of enumeration budget before the first one
+    auto unsolved = m_Solver->GetTruncated() && !m_Solver->GetApproximate();
+    // fall back to MinMineProb, or to a uniform guess if there are no probabilities
+    if (m_Deadline.Expired() || unsolved)
+    {
+        m_Degraded = true;
+        if (!unsolved && !BasicStrategy.DecisionTree.empty())
+            LARGEST(-m_Solver->GetProbability(blk));
+        return;
+    }
 
     for (auto heu : BasicStrategy.DecisionTree)
+    {
+        // out of time: keep the ties broken so far
+        if (m_Deadline.Expired())
+        {
+            m_Degraded = true;
+            break;
+        }
         switch (heu)
         {
         case HeuristicMethod::MinMineProb:
             LARGEST(-m_Solver->GetProbability(blk));
             break;
         case HeuristicMethod::MaxZeroProb:
-            LARGEST(m_Solver->ZeroCondQ(m_BlocksR[blk], blk) * (1 - m_Solver->GetProbability(blk)));
+            LARGEST_CLASS(m_Solver->ZeroCondQ(m_Topology->BlocksR[blk], blk) * (1 - m_Solver->GetProbability(blk)));
             break;
         case HeuristicMethod::MaxZerosProb:
-            LARGEST(m_Solver->ZerosCondQ(m_BlocksR[blk], blk) * (1 - m_Solver->GetProbability(blk)));
+            LARGEST_CLASS(m_Solver->ZerosCondQ(m_Topology->BlocksR[blk], blk) * (1 - m_Solver->GetProbability(blk)));
             break;
         case HeuristicMethod::MaxZerosExp:
-            LARGEST(m_Solver->ZerosECondQ(m_BlocksR[blk], blk) * (1 - m_Solver->GetProbability(blk)));
+            LARGEST_CLASS(m_Solver->ZerosECondQ(m_Topology->BlocksR[blk], blk) * (1 - m_Solver->GetProbability(blk)));
             break;
         case HeuristicMethod::MaxQuantityExp:
-            LARGEST(m_Solver->QuantityCondQ(m_BlocksR[blk], blk));
+            LARGEST_CLASS(m_Solver->QuantityCondQ(m_Topology->BlocksR[blk], blk));
             break;
         case HeuristicMethod::MinFrontierDist:
             LARGEST(-FrontierDist(blk));
             break;
         case HeuristicMethod::MaxUpperBound:
-            LARGEST(m_Solver->UpperBoundCondQ(m_BlocksR[blk], blk) * (1 - m_Solver->GetProbability(blk)));
+            LARGEST_CLASS(m_Solver->UpperBoundCondQ(m_Topology->BlocksR[blk], blk) * (1 - m_Solver->GetProbability(blk)));
             break;
         case HeuristicMethod::Relevant2:
             LARGEST(static_cast<int>(m_Blocks[blk].IsRelevant2));
             break;
+        case HeuristicMethod::MaxLookahead:
+            // timed on its own, as it costs far more than the others
+            pt.reset();
+            {
+                PhaseTimer lt{ Phase::Lookahead };
+                LargestByLookahead();
+            }
+            pt.emplace(Phase::Heuristic);
+            break;
         default:
             break;
         }
+    }
+}
+
+SolvingState GameMgr::Solve(SolvingState maxDepth, bool shortcut, Deadline deadline)
+{
+    auto saved = m_Deadline;
+    SetDeadline(std::move(deadline));
+    auto degraded = std::exchange(m_Degraded, false);
+    try
+    {
+        Solve(maxDepth, shortcut);
+    }
+    catch (...)
+    {
+        SetDeadline(saved);
+        m_Degraded |= degraded;
+        throw;
+    }
+    SetDeadline(saved);
+
+    auto reached = maxDepth & (SolvingState::Reduce | SolvingState::Overlap);
+    if (!m_Solver->GetTruncated())
+        reached |= maxDepth & SolvingState::Probability;
+    if (m_Solver->GetApproximate())
+        reached |= SolvingState::Approximate;
+    if (!m_Degraded)
+        reached |= maxDepth & SolvingState::Heuristic;
+    if (m_Drainer)
+        reached |= maxDepth & SolvingState::Drained;
+    m_Degraded |= degraded;
+    return reached;
 }
 
 void GameMgr::OpenOptimalBlocks()
@@ -486,9 +794,10 @@ bool GameMgr::SemiAutomaticStep(SolvingState maxDepth, bool single, bool nearest
             if (!m_Blocks[i].IsOpen && m_Solver->GetBlockStatus(i) == BlockStatus::Blank)
                 candidates.push_back(i);
 
-        auto &last = m_Blocks[m_LastProbe];
-        auto dist = [this, last](int id) {
-            return abs(m_Blocks[id].X - last.X) + abs(m_Blocks[id].Y - last.Y);
+        auto &coords = m_Topology->Blocks;
+        auto &last = coords[m_LastProbe];
+        auto dist = [&coords, last](int id) {
+            return abs(coords[id].X - last.X) + abs(coords[id].Y - last.Y);
         };
         auto id = *std::min_element(candidates.begin(), candidates.end(), [dist](int lhs, int rhs) {
             return dist(lhs) - dist(rhs);
@@ -622,22 +931,65 @@ void GameMgr::EnableDrainer(bool drain)
         return;
     if (!m_IsExternal)
         SemiAutomatic(SolvingState::Reduce | SolvingState::Overlap | SolvingState::Probability);
+    if (m_Solver->GetTruncated())
+    {
+        m_Degraded = true;
+        return;
+    }
+    // the drainer relies on every solution
+    if (m_Solver->GetApproximate())
+        return;
+    {
+        PhaseTimer pt{ Phase::DrainerGenerate };
 #ifndef NDEBUG
-    std::cerr << "GameMgr::EnableDrainer() calling Drainer::Drainer()\n";
+        std::cerr << "GameMgr::EnableDrainer() calling Drainer::Drainer()\n";
 #endif
-    m_Drainer = std::make_unique<Drainer>(*this);
-    if (!drain)
-        return;
+        m_Drainer = std::make_unique<Drainer>(*this);
 #ifndef NDEBUG
-    std::cerr << "GameMgr::EnableDrainer() calling Drainer::MakeProgress()\n";
+        if (drain)
+            std::cerr << "GameMgr::EnableDrainer() calling Drainer::MakeProgress()\n";
 #endif
-    while (m_Drainer->MakeProgress());
+        if (drain)
+            while (m_Drainer->MakeProgress());
+        if (m_Drainer->GetAbandoned())
+        {
+            m_Drainer.reset();
+            m_Degraded = true;
+            return;
+        }
+        if (!drain)
+            return;
+    }
 #ifndef NDEBUG
     std::cerr << "GameMgr::EnableDrainer() calling GameMgr::Solve()\n";
 #endif
     Solve(SolvingState::Probability | SolvingState::Drained, false);
 }
 
+void GameMgr::SetDeadline(Deadline deadline)
+{
+    m_Deadline = deadline;
+    m_Solver->SetDeadline(deadline);
+}
+
+void GameMgr::SetThreadPool(std::shared_ptr<ThreadPool> pool)
+{
+    m_Pool = std::move(pool);
+}
+
+bool GameMgr::GetDegraded() const
+{
+    return m_Degraded;
+}
+
+bool GameMgr::WouldDrain() const
+{
+    if (!BasicStrategy.HeuristicEnabled || !BasicStrategy.ExhaustEnabled)
+        return false;
+    return m_Solver->GetTotalStates() <= (BasicStrategy.PruningEnabled ? BasicStrategy.PruningCriterion : BasicStrategy.ExhaustCriterion) &&
+        (m_Solver->GetTotalStates() > 2 || m_ToOpen > 1) && !m_Solver->GetTruncated() && !m_Solver->GetApproximate();
+}
+
 size_t GameMgr::GetDrainerSteps() const
 {
     if (!m_Drainer)
@@ -680,21 +1032,115 @@ void GameMgr::Save(std::ostream &sw) const
         }
 }
 
+size_t GameMgr::MemoryUsage() const
+{
+    auto sz = sizeof(*this)
+        + m_Blocks.capacity() * sizeof(BlockState)
+        + (m_Best.capacity() + m_Preferred.capacity()) * sizeof(Block);
+    if (m_Solver)
+        sz += m_Solver->MemoryUsage();
+    return sz;
+}
+
+std::string GameMgr::Deflate(bool withSolver) const
+{
+    std::string buf;
+    buf.reserve(16 + (m_Settled ? m_Blocks.size() : 0) + m_Preferred.size());
+    SnapshotWriter sw{ buf };
+    sw.Byte(SNAP_VERSION);
+    sw.Byte((m_IsExternal ? SNAP_EXTERNAL : 0)
+            | (m_AllowWrongGuess ? SNAP_ALLOW_WRONG_GUESS : 0)
+            | (m_IsSNR ? SNAP_SNR : 0)
+            | (m_Settled ? SNAP_SETTLED : 0)
+            | (m_Started ? SNAP_STARTED : 0)
+            | (m_Succeed ? SNAP_SUCCEED : 0)
+            | (withSolver ? SNAP_SOLVER : 0));
+    sw.Unsigned(m_TotalWidth);
+    sw.Unsigned(m_TotalHeight);
+    sw.Signed(m_TotalMines);
+    sw.Signed(m_ToOpen);
+    sw.Unsigned(m_WrongGuesses);
+    sw.Signed(m_LastProbe);
+
+    if (m_Settled)
+        for (auto &blk : m_Blocks)
+        {
+            ASSERT(blk.Degree >= -1 && blk.Degree < SNAP_DEGREE);
+            sw.Byte((blk.Degree + 1)
+                    | (blk.IsOpen ? SNAP_OPEN : 0)
+                    | (blk.IsMine ? SNAP_MINE : 0)
+                    | (blk.IsRelevant2 ? SNAP_RELEVANT2 : 0));
+        }
+
+    for (auto lst : { &m_Best, &m_Preferred })
+    {
+        sw.Unsigned(lst->size());
+        auto last = 0;
+        for (auto blk : *lst)
+            sw.Signed(blk - last), last = blk;
+    }
+
+    if (withSolver)
+        m_Solver->Deflate(sw);
+    return buf;
+}
+
+std::tuple<int, int, int> GameMgr::SizeOf(std::string_view snapshot)
+{
+    SnapshotReader sr{ snapshot };
+    if (sr.Byte() != SNAP_VERSION)
+        throw std::runtime_error("snapshot version mismatch");
+    (void)sr.Byte();
+    auto width = sr.Unsigned();
+    auto height = sr.Unsigned();
+    auto mines = sr.Signed();
+    if (width > SNAP_MAX_SIDE || height > SNAP_MAX_SIDE || mines < -1 || mines > static_cast<int64_t>(width * height))
+        throw std::runtime_error("snapshot board size out of range");
+    return { static_cast<int>(width), static_cast<int>(height), static_cast<int>(mines) };
+}
+
 int GameMgr::GetIndex(int x, int y) const
 {
     return x * m_TotalHeight + y;
 }
 
+void GameMgr::PresetMines(BlockSet mines)
+{
+    if (m_IsExternal || m_Settled)
+        throw std::runtime_error("mines are already settled");
+    if (mines.size() != m_TotalMines)
+        throw std::runtime_error("number of preset mines mismatch");
+    m_PresetMines = std::move(mines);
+}
+
+BlockSet GameMgr::GetMines() const
+{
+    BlockSet mines;
+    if (m_IsExternal || !m_Settled)
+        return mines;
+    for (auto i = 0; i < m_Blocks.size(); ++i)
+        if (m_Blocks[i].IsMine)
+            mines.push_back(i);
+    return mines;
+}
+
 void GameMgr::SettleMines(int initID)
 {
-    for (auto totalMines = m_TotalMines; totalMines > 0;)
+    PhaseTimer pt{ Phase::Generate };
+    for (auto id : m_PresetMines)
+    {
+        if (id == initID)
+            throw std::runtime_error("preset mine at the first block");
+        m_Blocks[id].IsMine = true;
+    }
+    for (auto totalMines = m_PresetMines.empty() ? m_TotalMines : 0; totalMines > 0;)
     {
 again:
         auto id = RandomInteger(m_TotalWidth * m_TotalHeight);
         if (id == initID)
             goto again;
         if (m_IsSNR) {
-            for (auto &blk : m_BlocksR[initID])
+            for (auto &blk : m_Topology->BlocksR[initID])
                 if (id == blk)
                     goto again;
         }
@@ -703,6 +1149,7 @@ again:
         m_Blocks[id].IsMine = true;
         --totalMines;
     }
+    m_PresetMines = BlockSet{};
     m_Settled = true;
 
     for (auto i = 0; i < m_Blocks.size(); ++i)
@@ -710,39 +1157,67 @@ again:
         if (m_Blocks[i].IsMine)
             continue;
         m_Blocks[i].Degree = 0;
-        for (auto &id : m_BlocksR[i])
+        for (auto &id : m_Topology->BlocksR[i])
             if (m_Blocks[id].IsMine)
                 ++m_Blocks[i].Degree;
     }
 }
 
-void GameMgr::GenerateBlocksR()
+BoardTopology::BoardTopology(int width, int height)
 {
-    m_Blocks.reserve(m_TotalWidth * m_TotalHeight);
-    m_BlocksR.reserve(m_TotalWidth * m_TotalHeight);
+    Blocks.reserve(width * height);
+    BlocksR.reserve(width * height);
 
-    for (auto i = 0; i < m_TotalWidth; ++i)
-        for (auto j = 0; j < m_TotalHeight; ++j)
+    // same as GameMgr::GetIndex
+    auto index = [height](int x, int y) { return x * height + y; };
+    for (auto i = 0; i < width; ++i)
+        for (auto j = 0; j < height; ++j)
         {
-            m_Blocks.emplace_back();
-            m_BlocksR.emplace_back();
-            auto &blk = m_Blocks.back();
-            auto &blkR = m_BlocksR.back();
-            blk.Index = GetIndex(i, j);
-            blk.X = i;
-            blk.Y = j;
-            blk.IsOpen = false;
-            blk.IsMine = false;
+            Blocks.push_back({ index(i, j), i, j });
+            auto &blkR = BlocksR.emplace_back();
             blkR.reserve(8);
             for (auto di = -1; di <= 1; ++di)
-                if (i + di >= 0 && i + di < m_TotalWidth)
+                if (i + di >= 0 && i + di < width)
                     for (auto dj = -1; dj <= 1; ++dj)
-                        if (j + dj >= 0 && j + dj < m_TotalHeight)
+                        if (j + dj >= 0 && j + dj < height)
                             if (di != 0 || dj != 0)
-                                blkR.push_back(GetIndex(i + di, j + dj));
+                                blkR.push_back(index(i + di, j + dj));
         }
 }
 
+std::shared_ptr<const BoardTopology> BoardTopology::Of(int width, int height)
+{
+    static std::mutex mtx;
+    static std::map<std::pair<int, int>, std::weak_ptr<const BoardTopology>> cache;
+    // the last one stays alive, so that playing one game after another does not rebuild it each time
+    static thread_local std::shared_ptr<const BoardTopology> last;
+
+    std::lock_guard lock{ mtx };
+    auto &weak = cache[{ width, height }];
+    auto topo = weak.lock();
+    if (!topo)
+        weak = topo = std::make_shared<const BoardTopology>(width, height);
+    last = topo;
+    return topo;
+}
+
+void GameMgr::GenerateBlocksR()
+{
+    m_Topology = BoardTopology::Of(m_TotalWidth, m_TotalHeight);
+    m_Blocks.assign(m_TotalWidth * m_TotalHeight, BlockState{ 0, false, false, false });
+}
+
+void GameMgr::RestoreRestrains()
+{
+    for (auto i = 0; i < m_Blocks.size(); ++i)
+        if (m_Blocks[i].IsOpen)
+            m_Solver->AddRestrain(i, m_Blocks[i].IsMine);
+
+    for (auto i = 0; i < m_Blocks.size(); ++i)
+        if (m_Blocks[i].IsOpen && !m_Blocks[i].IsMine && m_Blocks[i].Degree >= 0)
+            m_Solver->AddRestrain(m_Topology->BlocksR[i], m_Blocks[i].Degree);
+}
+
 bool GameMgr::OpenBlock(int x, int y)
 {
     auto id = GetIndex(x, y);
@@ -784,10 +1259,10 @@ void GameMgr::OpenBlockImpl(int id)
     m_Solver->AddRestrain(id, false);
     if (m_Blocks[id].Degree == 0)
     {
-        for (auto &blk : m_BlocksR[id])
+        for (auto &blk : m_Topology->BlocksR[id])
             OpenBlockImpl(blk);
     }
-    m_Solver->AddRestrain(m_BlocksR[id], m_Blocks[id].Degree);
+    m_Solver->AddRestrain(m_Topology->BlocksR[id], m_Blocks[id].Degree);
 
     if (--m_ToOpen == 0)
     {
@@ -798,22 +1273,22 @@ void GameMgr::OpenBlockImpl(int id)
 
 void GameMgr::UpdateRelevant2Info(int id)
 {
-    for (auto blk : m_BlocksR[id])
+    for (auto blk : m_Topology->BlocksR[id])
     {
         if (m_Blocks[blk].IsOpen)
             continue;
-        for (auto b : m_BlocksR[blk])
+        for (auto b : m_Topology->BlocksR[blk])
             m_Blocks[b].IsRelevant2 = true;
     }
 }
 
 int GameMgr::FrontierDist(Block blk) const
 {
-    auto &bt = m_Blocks[blk];
+    auto &bt = m_Topology->Blocks[blk];
     auto d = MAX(m_TotalWidth, m_TotalHeight);
-    for (auto b : m_Blocks)
+    for (auto &b : m_Topology->Blocks)
     {
-        if (!b.IsOpen)
+        if (!m_Blocks[b.Index].IsOpen)
             continue;
         auto v = MAX(abs(b.X - bt.X), abs(b.Y - bt.Y));
         if (v < d)
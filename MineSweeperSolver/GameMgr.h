@@ -3,6 +3,8 @@
 #include "Solver.h"
 #include "Drainer.h"
 #include <optional>
+#include <string_view>
+#include <tuple>
 #include <vector>
 #include <memory>
 #include "Strategies.h"
@@ -18,6 +20,37 @@ struct
     bool IsRelevant2;
 };
 
+/* The mutable part of BlockProperty, owned by each GameMgr */
+struct
+    BlockState
+{
+    int Degree;
+    bool IsOpen;
+    bool IsMine;
+    bool IsRelevant2;
+};
+
+/* The immutable part of BlockProperty
+ * Note: Interned per width/height and shared by all GameMgr of that size,
+ * so that copying a GameMgr only copies the BlockState.
+ */
+struct
+    BoardTopology
+{
+    BoardTopology(int width, int height);
+
+    struct Coord
+    {
+        int Index;
+        int X, Y;
+    };
+
+    std::vector<Coord> Blocks;
+    std::vector<BlockSet> BlocksR; // each block's neighbor
+
+    [[nodiscard]] static std::shared_ptr<const BoardTopology> Of(int width, int height);
+};
+
 template <typename T>
 struct EmptyCopyable : std::unique_ptr<T>
 {
@@ -39,11 +72,21 @@ public:
     GameMgr(int width, int height, int totalMines, bool isSNR, Strategy strategy, bool allowWrongGuess = false);
     GameMgr(int width, int height, int totalMines, Strategy strategy);
     GameMgr(std::istream &sr, Strategy strategy);
+    GameMgr(std::string_view snapshot, Strategy strategy);
     GameMgr(const GameMgr &) = default;
     GameMgr(GameMgr &&) noexcept = default;
     GameMgr &operator=(const GameMgr &) = default;
     GameMgr &operator=(GameMgr &&) noexcept = default;
 
+    /* Start over with the same size, mines and BasicStrategy, as if just constructed,
+     * but keep the capacity of the blocks and of the solver, so that
+     * playing many games does not construct a GameMgr for each
+     *
+     * Note: BasicStrategy may be changed right before.
+     * Note: The drainer, the preset mines and the deadline are dropped.
+     */
+    void Reset();
+
     Strategy BasicStrategy;
 
     Solver &GetSolver();
@@ -53,6 +96,7 @@ public:
     [[nodiscard]] int GetTotalWidth() const;
     [[nodiscard]] int GetTotalHeight() const;
     [[nodiscard]] int GetTotalMines() const;
+    [[nodiscard]] bool GetSNR() const;
     [[nodiscard]] int GetToOpen() const;
     [[nodiscard]] int GetWrongGuesses() const;
     [[nodiscard]] bool GetSettled() const;
@@ -63,17 +107,22 @@ public:
     [[nodiscard]] int GetLastProbe() const;
     [[nodiscard]] double GetMinProbability() const;
     [[nodiscard]] double GetMaxProbability() const;
+    /* Standard error of the probabilities, 0 unless they were sampled, see BasicSolver::SetEnumerationBudget */
+    [[nodiscard]] double GetProbabilityError() const;
 
-    [[nodiscard]] const BlockProperty &GetBlockProperty(int x, int y) const;
-    const BlockProperty &SetBlockDegree(int x, int y, int degree);
-    const BlockProperty &SetBlockDegree(int id, int degree);
-    const BlockProperty &SetBlockMine(int x, int y, bool mined);
-    const BlockProperty &SetBlockMine(int id, bool mined);
-    [[nodiscard]] const BlockProperty *GetBlockProperties() const;
+    [[nodiscard]] BlockProperty GetBlockProperty(int x, int y) const;
+    BlockProperty SetBlockDegree(int x, int y, int degree);
+    BlockProperty SetBlockDegree(int id, int degree);
+    BlockProperty SetBlockMine(int x, int y, bool mined);
+    BlockProperty SetBlockMine(int id, bool mined);
     [[nodiscard]] double GetBlockProbability(int x, int y) const;
     [[nodiscard]] double GetBlockProbability(int id) const;
     [[nodiscard]] BlockStatus GetInferredStatus(int x, int y) const;
     [[nodiscard]] std::pair<int, int> GetDegreeBounds(int id) const;
+    /* Check if the blank block <id> can have <degree>, without copying nor solving
+     * Note: Exact once SolvingState::Probability is reached; otherwise only checks GetDegreeBounds.
+     */
+    [[nodiscard]] bool IsDegreeFeasible(int id, int degree);
 
     [[nodiscard]] const Block *GetBestBlocks() const;
     [[nodiscard]] size_t GetBestBlockCount() const;
@@ -85,7 +134,27 @@ public:
 
     bool OpenBlock(int x, int y);
 
+    /* Use <mines> instead of random ones when settling, so that
+     * the same board can be replayed under different strategies
+     *
+     * Note: Must be called before settled; the first opened block must not be a mine.
+     */
+    void PresetMines(BlockSet mines);
+    /* Location of all mines; empty if not settled */
+    [[nodiscard]] BlockSet GetMines() const;
+
     void Solve(SolvingState maxDepth, bool shortcut);
+    /* Same as Solve, but within <deadline> instead of the one of SetDeadline, which is restored afterwards
+     * return: how far it got, i.e. the parts of <maxDepth> done,
+     *   plus SolvingState::Approximate if the probabilities were sampled;
+     *   Heuristic means the choice was not degraded, even if no heuristic was needed
+     *
+     * Note: What is given up on is the same as once SetDeadline expires:
+     * certainties come first, then probabilities (possibly sampled), then heuristics.
+     * Best blocks, or preferred blocks, are there either way.
+     * Note: Reduce, Overlap and Gauss elimination are not interrupted, so large boards overshoot.
+     */
+    SolvingState Solve(SolvingState maxDepth, bool shortcut, Deadline deadline);
 
     void OpenOptimalBlocks();
 
@@ -94,11 +163,51 @@ public:
     void AutomaticStep(SolvingState maxDepth);
     void Automatic(bool drain = true);
 
+    /* Finish the game in time rather than in the best way: once <deadline> has expired,
+     * Drainer is skipped or abandoned, heuristics fall back to MinMineProb,
+     * and enumeration of solutions is cut short (see BasicSolver::GetTruncated),
+     * in which case the guess is uniform among unknown blocks.
+     *
+     * Note: Copies of the game keep the deadline, but their solvers do not.
+     */
+    void SetDeadline(Deadline deadline);
+    /* Some decision was made in a degraded way, see SetDeadline;
+     * also when no solution was found within the enumeration budget, see BasicSolver::SetEnumerationBudget
+     */
+    [[nodiscard]] bool GetDegraded() const;
+
+    /* Evaluate the heuristics of the candidates on <pool>, see Solver::Prefetch;
+     * nullptr (the default) evaluates them one by one on the calling thread.
+     * Decisions are the same either way.
+     *
+     * Note: Only pays off on large boards; copies of the game share the pool.
+     */
+    void SetThreadPool(std::shared_ptr<ThreadPool> pool);
+
     void EnableDrainer(bool drain);
+    /* Solve(... | SolvingState::Drained) would build Drainer on the current solution,
+     * as there are few enough solutions and they are all known
+     */
+    [[nodiscard]] bool WouldDrain() const;
     [[nodiscard]] size_t GetDrainerSteps() const;
     [[nodiscard]] bool MakeDrainerProgress();
 
     void Save(std::ostream &sw) const;
+    /* Compact alternative to Save(), to be loaded by GameMgr(std::string_view, Strategy)
+     * Each block takes one byte: 4-bit degree plus open/mine/relevant2 bits.
+     *
+     * withSolver == true: carry the reduced state of the solver,
+     *   so that loading needs neither AddRestrain nor Solve
+     * withSolver == false: the solver is rebuilt from opened blocks, as in Save()
+     */
+    [[nodiscard]] std::string Deflate(bool withSolver = true) const;
+    /* Width, height and total mines of a snapshot by Deflate(), read without loading it
+     * Note: Throws std::runtime_error on a malformed header.
+     */
+    [[nodiscard]] static std::tuple<int, int, int> SizeOf(std::string_view snapshot);
+
+    /* Approximate number of bytes held, including the solver but not the drainer */
+    [[nodiscard]] size_t MemoryUsage() const;
 
     friend class Drainer;
 private:
@@ -107,23 +216,56 @@ private:
     int m_TotalWidth, m_TotalHeight, m_TotalMines;
     bool m_IsSNR;
     bool m_Settled, m_Started, m_Succeed;
-    std::vector<BlockProperty> m_Blocks;
-    std::vector<BlockSet> m_BlocksR; // each block's neighbor
+    std::shared_ptr<const BoardTopology> m_Topology;
+    std::vector<BlockState> m_Blocks;
     int m_ToOpen, m_WrongGuesses;
     std::optional<Solver> m_Solver;
     double m_AllBits;
     BlockSet m_Best, m_Preferred;
     EmptyCopyable<Drainer> m_Drainer;
     int m_LastProbe;
+    BlockSet m_PresetMines; // cleared once settled
+    Deadline m_Deadline;
+    bool m_Degraded;
+    std::shared_ptr<ThreadPool> m_Pool;
 
     [[nodiscard]] int GetIndex(int x, int y) const;
+    [[nodiscard]] BlockProperty PropertyOf(int id) const;
 
     void GenerateBlocksR();
+    void RestoreRestrains();
     void SettleMines(int initID);
     void OpenBlockImpl(int id);
     void UpdateRelevant2Info(int id);
 
     [[nodiscard]] int FrontierDist(Block blk) const;
+
+    /* Same as Largest(m_Preferred, <fun>), but <fun> is evaluated once per group of Solver::Classify,
+     * after prefetching <method> on m_Pool if any
+     */
+    template <typename F>
+    void LargestByClass(HeuristicMethod method, const F &fun);
+    std::vector<size_t> m_Classes_Temp;
+    std::vector<double> m_Values_Temp; // by block
+
+    // HeuristicMethod::MaxLookahead evaluates at most this many groups of Solver::Classify per Solve
+    static constexpr size_t LookaheadCandidates = 8;
+    // ... and gives up after this long, or at the deadline of the game if earlier
+    static constexpr std::chrono::milliseconds LookaheadBudget{ 20 };
+
+    /* Probability that opening <blk> is safe and leaves some block to open for sure:
+     * for each feasible degree of <blk>, a copy of the solver is told that degree,
+     * as SetBlockDegree would, and solved until <deadline>.
+     *
+     * Note: Once <deadline> has expired, the result is incomplete.
+     */
+    [[nodiscard]] double Lookahead(Block blk, const Deadline &deadline);
+    /* Same as LargestByClass(HeuristicMethod::MaxLookahead, Lookahead), but only the
+     * LookaheadCandidates least probable groups are evaluated, within LookaheadBudget;
+     * the others are no longer preferred.
+     */
+    void LargestByLookahead();
+    std::vector<size_t> m_Lookahead_Temp;
 };
 
 template <typename F>
@@ -132,8 +274,8 @@ Largest(BlockSet &bests, const F &fun)
 {
     if (bests.size() <= 1)
         return;
-    BlockSet newBests;
-    newBests.push_back(bests.front());
+    // the ties are compacted in place, as they never go ahead of the scan
+    size_t n = 1;
     auto bestVal = fun(bests.front());
     for (auto i = 1; i < bests.size(); ++i)
     {
@@ -141,12 +283,12 @@ Largest(BlockSet &bests, const F &fun)
         if (bestVal < p)
         {
             bestVal = p;
-            newBests.clear();
+            n = 0;
         }
         if (bestVal <= p)
-            newBests.push_back(bests[i]);
+            bests[n++] = bests[i];
     }
-    newBests.swap(bests);
+    bests.resize(n);
 }
 
 template <typename F>
@@ -155,8 +297,8 @@ Largest(BlockSet &bests, const F &fun)
 {
     if (bests.size() <= 1)
         return;
-    BlockSet newBests;
-    newBests.push_back(bests.front());
+    // see above
+    size_t n = 1;
     auto bestVal = fun(bests.front());
     for (auto i = 1; i < bests.size(); ++i)
     {
@@ -164,10 +306,10 @@ Largest(BlockSet &bests, const F &fun)
         if (bestVal < p)
         {
             bestVal = p;
-            newBests.clear();
+            n = 0;
         }
         if (bestVal - std::abs(bestVal) * 1E-8 <= p)
-            newBests.push_back(bests[i]);
+            bests[n++] = bests[i];
     }
-    newBests.swap(bests);
+    bests.resize(n);
 }
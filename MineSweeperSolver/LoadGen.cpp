@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "daemon.hpp"
+
+static constexpr const char *OPS[]{ "load", "solve", "click", "best" };
+
+// latencies of one client, in ns, by op
+struct client_stats {
+    std::vector<uint64_t> ns[std::size(OPS)];
+    size_t games = 0, won = 0, errors = 0;
+};
+
+auto now() {
+    return std::chrono::steady_clock::now();
+}
+
+uint64_t nanos(std::chrono::steady_clock::time_point begin) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now() - begin).count();
+}
+
+int connect_to(const std::string &path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+        throw std::runtime_error(path + ": " + std::strerror(errno));
+    return fd;
+}
+
+// send <req> and time until the reply is in; the body of the reply is left in <body>
+bool call(int fd, std::string &req, std::string &reply, std::string_view &body, client_stats &st) {
+    std::string_view head{ req };
+    head.remove_prefix(sizeof(uint32_t));
+    auto op = static_cast<size_t>(get<daemon_op>(head)) - 1;
+    auto begin = now();
+    if (!write_frame(fd, req) || !read_frame(fd, reply))
+        throw std::runtime_error("daemon is gone");
+    st.ns[op].push_back(nanos(begin));
+    body = reply;
+    if (get<daemon_status>(body) != daemon_status::ok) {
+        st.errors++;
+        return false;
+    }
+    return true;
+}
+
+// play <games> games to the end, asking for the probabilities and the best move before each click
+void client(const std::string &path, const std::string &config, size_t games, uint32_t budget, bool probabilities, client_stats &st) {
+    auto fd = connect_to(path);
+    std::string req, reply;
+    std::string_view body;
+    for (size_t g = 0; g < games; g++) {
+        req = begin_frame(daemon_op::load);
+        put(req, static_cast<uint16_t>(config.size()));
+        req += config;
+        if (!call(fd, req, reply, body, st))
+            break;
+        st.games++;
+        while (true) {
+            if (probabilities) {
+                req = begin_frame(daemon_op::solve);
+                put(req, budget);
+                if (!call(fd, req, reply, body, st))
+                    break;
+            }
+            req = begin_frame(daemon_op::best);
+            put(req, budget);
+            if (!call(fd, req, reply, body, st))
+                break;
+            (void)get<uint32_t>(body);
+            auto blk = get<int32_t>(body);
+            if (blk < 0)
+                break;
+            req = begin_frame(daemon_op::click);
+            put(req, blk);
+            if (!call(fd, req, reply, body, st))
+                break;
+            auto started = get<uint8_t>(body), succeed = get<uint8_t>(body);
+            if (succeed)
+                st.won++;
+            if (!started || succeed)
+                break;
+        }
+    }
+    close(fd);
+}
+
+uint64_t percentile(const std::vector<uint64_t> &sorted, double q) {
+    if (sorted.empty())
+        return 0;
+    return sorted[std::min(sorted.size() - 1, static_cast<size_t>(q * static_cast<double>(sorted.size())))];
+}
+
+int main(int argc, char *argv[]) {
+    const auto prog = argv[0];
+    auto usage = [prog] {
+        std::cout << "Usage: " << prog << R"( [-s <socket>] [-c <clients>] [-n <games>] [-t <budget>] [-q] [<config>])"
+                  << "\n  -s: connect to MineSweeperDaemon at <socket>, default mws.sock"
+                  << "\n  -c: <clients> concurrent sessions, default 4"
+                  << "\n  -n: games played by each client, default 100"
+                  << "\n  -t: microseconds for each solve and best move, default 0 for none"
+                  << "\n  -q: only ask for the best move, not for the probabilities before it"
+                  << "\nGames are of <config>, default FL@[1,1]-PSEQ-30-16-T99-SFAR, played by the best moves."
+                  << "\nOne line per request type, then a summary; latencies are in us."
+                  << std::endl;
+        return 2;
+    };
+
+    std::string path = "mws.sock";
+    size_t clients = 4, games = 100;
+    uint32_t budget = 0;
+    auto probabilities = true;
+    for (int opt; (opt = getopt(argc, argv, "s:c:n:t:q")) != -1;)
+        switch (opt) {
+            case 's':
+                path = optarg;
+                break;
+            case 'c':
+                clients = std::strtoul(optarg, nullptr, 10);
+                if (!clients)
+                    return usage();
+                break;
+            case 'n':
+                games = std::strtoul(optarg, nullptr, 10);
+                break;
+            case 't':
+                budget = std::strtoul(optarg, nullptr, 10);
+                break;
+            case 'q':
+                probabilities = false;
+                break;
+            default:
+                return usage();
+        }
+    if (argc - optind > 1)
+        return usage();
+    std::string config = optind < argc ? argv[optind] : "FL@[1,1]-PSEQ-30-16-T99-SFAR";
+
+    std::vector<client_stats> stats(clients);
+    std::vector<std::thread> threads;
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    auto begin = now();
+    for (auto i = 0z; i < clients; i++)
+        threads.emplace_back([&, i] {
+            try {
+                client(path, config, games, budget, probabilities, stats[i]);
+            } catch (...) {
+                std::lock_guard lock{ error_mutex };
+                error = std::current_exception();
+            }
+        });
+    for (auto &th : threads)
+        th.join();
+    auto seconds = static_cast<double>(nanos(begin)) / 1e9;
+    if (error)
+        try {
+            std::rethrow_exception(error);
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+
+    size_t requests = 0, played = 0, won = 0, errors = 0;
+    for (auto op = 0z; op < std::size(OPS); op++) {
+        std::vector<uint64_t> all;
+        for (auto &st : stats)
+            all.insert(all.end(), st.ns[op].begin(), st.ns[op].end());
+        if (all.empty())
+            continue;
+        std::sort(all.begin(), all.end());
+        requests += all.size();
+        nlohmann::json j;
+        j["op"] = OPS[op];
+        j["requests"] = all.size();
+        j["p50"] = static_cast<double>(percentile(all, 0.50)) / 1e3;
+        j["p99"] = static_cast<double>(percentile(all, 0.99)) / 1e3;
+        j["max"] = static_cast<double>(all.back()) / 1e3;
+        std::cout << j << std::endl;
+    }
+    for (auto &st : stats)
+        played += st.games, won += st.won, errors += st.errors;
+
+    nlohmann::json j;
+    j["config"] = config;
+    j["clients"] = clients;
+    j["games"] = played;
+    j["won"] = won;
+    j["errors"] = errors;
+    j["seconds"] = seconds;
+    j["requests-per-second"] = static_cast<double>(requests) / seconds;
+    std::cout << j << std::endl;
+    return 0;
+}
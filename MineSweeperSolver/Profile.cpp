@@ -0,0 +1,61 @@
+#include "Profile.h"
+#include "GameMgr.h"
+#include <bit>
+#include <sstream>
+
+constinit thread_local PhaseProfile *CurrentProfile = nullptr;
+constinit thread_local SolveRecorder *CurrentRecorder = nullptr;
+
+void PhaseProfile::Clear()
+{
+    Nanos.fill(0);
+    Calls.fill(0);
+    Allocations.fill(0);
+    Solves = 0;
+    Busy = false;
+}
+
+SolveRecorder::SolveRecorder(std::chrono::steady_clock::duration threshold, std::function<void(const SolveRecord &)> sink)
+    : m_Threshold(threshold), m_Sink(std::move(sink)), m_Record{}, m_Busy(false) { }
+
+bool SolveRecorder::Begin(const GameMgr &mgr, SolvingState maxDepth, bool shortcut)
+{
+    // nothing worth recording before the mines are settled
+    if (m_Busy || !mgr.GetSettled())
+        return false;
+    m_Busy = true;
+    std::ostringstream ss;
+    mgr.Save(ss);
+    m_Record.Snapshot = std::move(ss).str();
+    m_Record.MaxDepth = maxDepth;
+    m_Record.Shortcut = shortcut;
+    m_Start = std::chrono::steady_clock::now();
+    return true;
+}
+
+void SolveRecorder::End(const GameMgr &mgr, bool completed)
+{
+    m_Busy = false;
+    m_Record.Took = std::chrono::steady_clock::now() - m_Start;
+    if (!completed || m_Record.Took < m_Threshold)
+        return;
+    m_Record.BasicStrategy = mgr.BasicStrategy;
+    m_Sink(m_Record);
+}
+
+size_t HistogramBucket(uint64_t value)
+{
+    value = MIN(value, UINT32_MAX);
+    if (value < 8)
+        return value;
+    auto exp = std::bit_width(value) - 1; // >= 3
+    return 8 + (exp - 3) * 8 + (value >> (exp - 3) & 7);
+}
+
+uint64_t HistogramLowerBound(size_t bucket)
+{
+    if (bucket < 8)
+        return bucket;
+    auto exp = (bucket - 8) / 8 + 3;
+    return (8 + (bucket - 8) % 8) << (exp - 3);
+}
@@ -0,0 +1,170 @@
+#pragma once
+#include "stdafx.h"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include "BasicSolver.h"
+#include "Strategies.h"
+
+class GameMgr;
+
+/* Phases of solving a game, see PhaseTimer */
+enum class Phase
+{
+    Generate, // GameMgr::SettleMines
+    Reduce, // BasicSolver::ReduceRestrains
+    Overlap, // BasicSolver::SimpleOverlapAll
+    Gauss, // BasicSolver::Gauss
+    Enumerate, // BasicSolver::EnumerateSolutions
+    Sample, // BasicSolver::SampleSolutions, instead of enumerating
+    Process, // BasicSolver::ProcessSolutions
+    Heuristic, // heuristic part of GameMgr::Solve, mostly Solver::*CondQ
+    Lookahead, // HeuristicMethod::MaxLookahead in GameMgr::Solve
+    DrainerGenerate, // constructing Drainer, and Drainer::MakeProgress
+    Drain, // Drainer::Update
+    Count
+};
+
+/* Cumulative time, number of calls and heap allocations of each phase, and number of solves
+ *
+ * Note: Nested phases are attributed to the outermost one,
+ * e.g. solving micro situations counts as Phase::DrainerGenerate,
+ * so the phases never overlap.
+ * Note: Allocations are counted by the operator new of MineSweeperSolver, see CountingNew.cpp;
+ * other binaries leave them at zero.
+ */
+struct
+    PhaseProfile
+{
+    std::array<uint64_t, static_cast<size_t>(Phase::Count)> Nanos;
+    std::array<uint64_t, static_cast<size_t>(Phase::Count)> Calls;
+    // [Phase::Count] for allocations outside of any phase
+    std::array<uint64_t, static_cast<size_t>(Phase::Count) + 1> Allocations;
+    uint64_t Solves; // BasicSolver::TrySolve that did not return early
+    bool Busy; // some PhaseTimer is running
+    Phase Current; // the running phase, if Busy
+
+    void Clear();
+};
+
+/* Profile of the current thread; nullptr (the default) disables profiling */
+extern constinit thread_local PhaseProfile *CurrentProfile;
+
+/* Charge the lifetime of this object to a phase of CurrentProfile
+ *
+ * Note: Costs a single branch if profiling is disabled.
+ */
+class
+    PhaseTimer
+{
+public:
+    explicit PhaseTimer(Phase phase) : m_Profile(CurrentProfile), m_Phase(phase)
+    {
+        if (!m_Profile)
+            return;
+        if (m_Profile->Busy)
+        {
+            m_Profile = nullptr;
+            return;
+        }
+        m_Profile->Busy = true;
+        m_Profile->Current = m_Phase;
+        m_Start = std::chrono::steady_clock::now();
+    }
+
+    ~PhaseTimer()
+    {
+        if (!m_Profile)
+            return;
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_Start);
+        m_Profile->Nanos[static_cast<size_t>(m_Phase)] += ns.count();
+        m_Profile->Calls[static_cast<size_t>(m_Phase)]++;
+        m_Profile->Busy = false;
+    }
+
+    PhaseTimer(const PhaseTimer &) = delete;
+    PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+private:
+    PhaseProfile *m_Profile;
+    Phase m_Phase;
+    std::chrono::steady_clock::time_point m_Start;
+};
+
+/* A position on which GameMgr::Solve took long, see SolveRecorder */
+struct
+    SolveRecord
+{
+    std::string Snapshot; // by GameMgr::Save, right before solving
+    Strategy BasicStrategy;
+    SolvingState MaxDepth;
+    bool Shortcut;
+    std::chrono::steady_clock::duration Took;
+};
+
+/* Hand positions on which GameMgr::Solve takes at least <threshold> over to <sink>
+ *
+ * Note: Solves nested in another one (e.g. by GameMgr::EnableDrainer) are part of the outer one.
+ * Note: Solves that throw are not recorded.
+ */
+class
+    SolveRecorder
+{
+public:
+    SolveRecorder(std::chrono::steady_clock::duration threshold, std::function<void(const SolveRecord &)> sink);
+
+    // return false if not recording this solve
+    [[nodiscard]] bool Begin(const GameMgr &mgr, SolvingState maxDepth, bool shortcut);
+    void End(const GameMgr &mgr, bool completed);
+
+private:
+    std::chrono::steady_clock::duration m_Threshold;
+    std::function<void(const SolveRecord &)> m_Sink;
+    SolveRecord m_Record;
+    std::chrono::steady_clock::time_point m_Start;
+    bool m_Busy;
+};
+
+/* Recorder of the current thread; nullptr (the default) disables recording */
+extern constinit thread_local SolveRecorder *CurrentRecorder;
+
+/* Record the solve within the lifetime of this object by CurrentRecorder
+ *
+ * Note: Costs a single branch if recording is disabled.
+ */
+class
+    SolveRecording
+{
+public:
+    SolveRecording(const GameMgr &mgr, SolvingState maxDepth, bool shortcut) : m_Recorder(CurrentRecorder), m_Mgr(mgr)
+    {
+        if (m_Recorder && !m_Recorder->Begin(mgr, maxDepth, shortcut))
+            m_Recorder = nullptr;
+        m_Exceptions = std::uncaught_exceptions();
+    }
+
+    ~SolveRecording()
+    {
+        if (m_Recorder)
+            m_Recorder->End(m_Mgr, std::uncaught_exceptions() == m_Exceptions);
+    }
+
+    SolveRecording(const SolveRecording &) = delete;
+    SolveRecording &operator=(const SolveRecording &) = delete;
+
+private:
+    SolveRecorder *m_Recorder;
+    const GameMgr &m_Mgr;
+    int m_Exceptions;
+};
+
+/* Log-linear histogram buckets with 3 significant bits (error <= 12.5%), as in HdrHistogram:
+ * values 0..7 have their own buckets, and each power of 2 above is split into 8 buckets.
+ *
+ * Note: Values are clamped to 2^32-1.
+ */
+#define HISTOGRAM_BUCKETS (8 + 29 * 8)
+size_t HistogramBucket(uint64_t value);
+/* The smallest value of a bucket */
+uint64_t HistogramLowerBound(size_t bucket);
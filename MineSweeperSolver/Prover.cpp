@@ -2,17 +2,16 @@
 #include "facade.hpp"
 #include "Prover.h"
 #include "GameMgr.h"
+#include "Snapshot.h"
 #include <exception>
 #include <fmt/ostream.h>
 #include <fmt/ranges.h>
 #include <sys/sysinfo.h>
 #include <condition_variable>
-#include <sstream>
 #include <stdexcept>
 #include <thread>
 #include <ranges>
-
-#include <fstream>
+#include <set>
 
 #ifndef TRACEBACK
 #define Traceback ""
@@ -22,8 +21,19 @@ Strategy g_Strategy;
 static constexpr auto HEUR = SolvingState::Reduce | SolvingState::Overlap | SolvingState::Probability | SolvingState::Heuristic;
 
 std::atomic<unsigned> g_MaxDepth;
-std::atomic<double> g_MemoryAvailPercent;
 std::atomic<size_t> g_Processed;
+std::atomic<size_t> g_Abandoned;
+
+// bytes held by inflated GameMgrs and by deflated snapshots
+std::atomic<size_t> g_InflatedBytes;
+std::atomic<size_t> g_DeflatedBytes;
+std::atomic<size_t> g_Evicted;
+size_t g_MemoryBudget;
+
+auto memoryUsage()
+{
+    return g_InflatedBytes.load() + g_DeflatedBytes.load();
+}
 
 auto updateDepth(unsigned d)
 {
@@ -34,40 +44,67 @@ auto updateDepth(unsigned d)
     return d;
 }
 
-void updateMemoryAvailPercent()
-{
-    std::ifstream fin("/proc/meminfo");
-    size_t total, avail;
-    std::string s;
-    fin >> s >> total >> s;
-    fin >> s >> avail >> s;
-    fin >> s >> avail >> s;
-    g_MemoryAvailPercent.store(100.0 * avail / total);
-}
-
 BaseCase::BaseCase(PCase p)
     : parent{ p },
       TotalStates{ p->TotalStates },
       Depth{ p->Depth },
       Duplication{},
-      m_Game{ p->m_Game } { }
+      Abandoned{ false },
+      m_Base{ p->m_Base },
+      m_Pending{ 1 },
+      m_Bytes{}
+{
+    p->m_Pending++;
+    SetGame(p->m_Game);
+}
 
 BaseCase::BaseCase(PCase p, PGame game)
     : parent{ p },
       TotalStates{ game->GetSolver().GetTotalStates() },
       Depth{ p ? p->Depth : 0u },
       Duplication{},
-      m_Game{ std::move(game) } { }
+      Abandoned{ false },
+      m_Pending{ 1 },
+      m_Bytes{}
+{
+    if (p)
+        p->m_Pending++;
+    SetGame(std::move(game));
+}
 
-BaseCase::~BaseCase() = default;
+BaseCase::~BaseCase()
+{
+    SetGame(std::monostate{});
+}
+
+void BaseCase::SetGame(GameHolder game)
+{
+    if (std::holds_alternative<std::string>(m_Game))
+        g_DeflatedBytes -= m_Bytes;
+    else if (std::holds_alternative<PGame>(m_Game))
+        g_InflatedBytes -= m_Bytes;
+
+    m_Game = std::move(game);
+
+    if (std::holds_alternative<std::string>(m_Game))
+        g_DeflatedBytes += m_Bytes = std::get<std::string>(m_Game).capacity();
+    else if (std::holds_alternative<PGame>(m_Game))
+        g_InflatedBytes += m_Bytes = std::get<PGame>(m_Game)->MemoryUsage();
+    else
+        m_Bytes = 0;
+}
 
 PGame BaseCase::ThePGame()
 {
     if (std::holds_alternative<PGame>(m_Game))
         return std::get<PGame>(m_Game);
 
-    std::stringstream ss{ std::get<std::string>(std::move(m_Game)) };
-    m_Game = std::make_shared<GameMgr>(ss, g_Strategy);
+    auto &str = std::get<std::string>(m_Game);
+    // the snapshot carries the solver, so no need to Solve again
+    SetGame(m_Base
+        ? std::make_shared<GameMgr>(DeltaDecode(str, *m_Base), g_Strategy)
+        : std::make_shared<GameMgr>(str, g_Strategy));
+    m_Base.reset();
     return std::get<PGame>(m_Game);
 }
 
@@ -94,22 +131,58 @@ PCase BaseCase::CheckedFork()
 #endif
 }
 
-BaseCase &BaseCase::Deflate()
+bool BaseCase::IsAbandoned() const
+{
+    for (auto ptr = this; ptr; ptr = ptr->parent)
+        if (ptr->Abandoned)
+            return true;
+    return false;
+}
+
+void BaseCase::Resolve(int n)
+{
+    if (m_Pending.fetch_sub(n) == n)
+        OnResolved();
+}
+
+BaseCase &BaseCase::Deflate(std::shared_ptr<const std::string> base)
 {
     if (std::holds_alternative<std::string>(m_Game))
         return *this;
 
-    std::stringstream ss;
-    std::get<PGame>(m_Game)->Save(ss);
-    m_Game = ss.str();
+    if (!(m_Base = std::move(base)))
+        SetGame(std::get<PGame>(m_Game)->Deflate());
+    else
+        SetGame(DeltaEncode(std::get<PGame>(m_Game)->Deflate(), *m_Base));
     return *this;
 }
 
+const std::shared_ptr<const std::string> &BaseCase::Snapshot()
+{
+    if (!m_Snapshot)
+    {
+        auto str = new std::string(Game().Deflate());
+        g_DeflatedBytes += str->capacity();
+        m_Snapshot.reset(str, [](const std::string *ptr)
+        {
+            g_DeflatedBytes -= ptr->capacity();
+            delete ptr;
+        });
+    }
+    return m_Snapshot;
+}
+
 bool HolderCase::Comparer::operator()(ActionCase *lhs, ActionCase *rhs) const
 {
     return lhs->Danger > rhs->Danger;
 }
 
+HolderCase::~HolderCase()
+{
+    for (auto ac : m_Heap)
+        delete ac;
+}
+
 void HolderCase::AddChildren(ActionCase *v)
 {
     std::lock_guard lock{ mtx };
@@ -119,6 +192,7 @@ void HolderCase::AddChildren(ActionCase *v)
 void HolderCase::ReportDanger(ActionCase *self, double v)
 {
     auto increase = 0.0;
+    auto abandoned = 0;
     if (!self)
     {
         increase = Danger = v; // initial danger prediction from UnsafeCase
@@ -129,6 +203,7 @@ void HolderCase::ReportDanger(ActionCase *self, double v)
         self->Danger += v;
 
         m_Heap.decrease(self->Handle);
+        abandoned = TryAbandon(self);
 
         auto next = m_Heap.top()->Danger;
         increase = next > Danger ? next - Danger : 0;
@@ -167,11 +242,50 @@ void HolderCase::ReportDanger(ActionCase *self, double v)
 #endif
         ac->ReportDanger(increase);
     }
+
+    if (abandoned)
+        Resolve(abandoned);
+}
+
+void HolderCase::ReportProved(ActionCase *self)
+{
+    auto resolved = 0;
+    {
+        std::lock_guard lock{ mtx };
+        if (self->Abandoned)
+            return; // already resolved when abandoned
+        self->IsProved = true;
+        resolved++;
+        if (self->Danger < Proved)
+        {
+            Proved = self->Danger;
+            for (auto ac : m_Heap)
+                resolved += TryAbandon(ac);
+        }
+    }
+    Resolve(resolved);
+}
+
+int HolderCase::TryAbandon(ActionCase *self)
+{
+    // Danger only increases, so self can never beat the proved sibling
+    if (self->IsProved || self->Abandoned || self->Danger < Proved)
+        return 0;
+#ifndef NDEBUG
+    fmt::print("[[[{}@{} abandoned: {:5e} >= {:5e}]]]\n",
+            self->ToString(),
+            fmt::ptr(self),
+            self->Danger,
+            Proved);
+#endif
+    self->Abandoned = true;
+    g_Abandoned++;
+    return 1;
 }
 
 void ActionCase::ReportDanger(double v)
 {
-    if (!v)
+    if (!v || Abandoned)
         return;
 #ifndef NDEBUG
     auto hc = dynamic_cast<HolderCase *>(parent);
@@ -187,10 +301,16 @@ template <bool Ephermeral>
 PCase ForkedCase::Fork()
 {
     auto [lb, ub] = Game().GetDegreeBounds(Id);
+    if (m_Degree < lb)
+        m_Degree = lb;
     while (m_Degree <= ub)
     {
-        if (m_Degree < lb)
+        // much cheaper than copying and solving only to find it infeasible
+        if (!Game().IsDegreeFeasible(Id, m_Degree))
+        {
+            m_Degree++;
             continue;
+        }
         auto g = std::make_shared<GameMgr>(Game());
         g->SetBlockDegree(Id, m_Degree++);
         g->Solve(HEUR, false);
@@ -199,12 +319,28 @@ PCase ForkedCase::Fork()
         if (g->GetSolver().GetTotalStates() == 1)
             continue; // guaranteed win
         auto p = Ephermeral ? parent : this;
-        auto c = g->GetBestBlockCount()
-            ? static_cast<BaseCase *>(new SafeCase(p, g))
-            : new UnsafeCase(p, g);
+        BaseCase *c;
+        if (g->GetBestBlockCount())
+            c = new SafeCase(p, g);
+        else
+        {
+            auto uc = new UnsafeCase(p, g);
+#ifndef NDEBUG
+            auto ac = dynamic_cast<ActionCase *>(p);
+            if (!ac)
+                throw std::logic_error{ "Parent of UnsafeCase must be ActionCase!" };
+#else
+            auto ac = reinterpret_cast<ActionCase *>(p);
+#endif
+            ac->Adopt(uc);
+            c = uc;
+        }
 #ifdef TRACEBACK
         c->Traceback = Traceback + fmt::format("[{}]={}", Id, m_Degree - 1);
 #endif
+        // the deepest cases are the last to be popped
+        if (memoryUsage() > g_MemoryBudget)
+            c->Deflate(Snapshot());
         return c;
     }
     return nullptr;
@@ -212,11 +348,32 @@ PCase ForkedCase::Fork()
 
 ActionCase::ActionCase(PCase p, PGame g, int id)
     : ForkedCase{ p, g, id },
-      Danger{ Game().GetBlockProbability(id) * TotalStates }
+      Danger{ Game().GetBlockProbability(id) * TotalStates },
+      IsProved{ false }
 {
     updateDepth(++Depth);
 }
 
+ActionCase::~ActionCase() = default;
+
+void ActionCase::Adopt(UnsafeCase *c)
+{
+    std::lock_guard lock{ m_AdoptMtx };
+    m_Adopted.emplace_back(c);
+}
+
+void ActionCase::OnResolved()
+{
+#ifndef NDEBUG
+    auto hc = dynamic_cast<HolderCase *>(parent);
+    if (!hc)
+        throw std::logic_error{ "Parent of ActionCase must be HolderCase!" };
+#else
+    auto hc = reinterpret_cast<HolderCase *>(parent);
+#endif
+    hc->ReportProved(this);
+}
+
 PCase ActionCase::Fork()
 {
     if (!m_Degree)
@@ -228,7 +385,7 @@ PCase ActionCase::Fork()
             throw std::logic_error{ "All ActionCase should be feasible" };
         if (g->GetSolver().GetTotalStates() == 1)
             return nullptr; // guaranteed win
-        m_Game = g;
+        SetGame(g);
     }
 
     return ForkedCase::Fork<false>();
@@ -324,6 +481,22 @@ class ConcurrentPriorityQueue
         }
     };
 
+    // the least important first, ties broken by address so that each case is found again
+    struct VictimComparer
+    {
+        bool operator()(const PCase &lhs, const PCase &rhs) const
+        {
+            if (Comparer{}(lhs, rhs))
+                return true;
+            if (Comparer{}(rhs, lhs))
+                return false;
+            return std::less<PCase>{}(lhs, rhs);
+        }
+    };
+
+    // the inflated cases of c, candidates for evict()
+    std::set<PCase, VictimComparer> inflated;
+
     auto done() const { return initialized && !borrowed && c.empty(); }
 
 public:
@@ -339,8 +512,8 @@ public:
             std::unique_lock lock{ mtx };
             c.push_back(p);
             std::ranges::push_heap(c, Comparer{});
-            if (g_MemoryAvailPercent.load() < 90)
-                p->Deflate();
+            if (p->IsInflated())
+                inflated.insert(p);
         }
         cv.notify_one();
     }
@@ -382,23 +555,47 @@ public:
         std::ranges::pop_heap(c, Comparer{});
         auto p = std::move(c.back());
         c.pop_back();
+        inflated.erase(p);
         return p;
     }
 
+    // deflate the least important cases until usage drops below <target>
+    void evict(size_t target)
+    {
+        std::unique_lock lock{ mtx };
+        auto usage = memoryUsage();
+        if (usage <= g_MemoryBudget)
+            return;
+
+        // count what is freed here rather than re-reading the totals, which other threads move
+        while (!inflated.empty() && usage > target)
+        {
+            auto p = *inflated.begin();
+            inflated.erase(inflated.begin());
+            usage -= p->GetBytes();
+            usage += p->Deflate().GetBytes();
+            g_Evicted++;
+        }
+    }
+
     template <typename T>
     bool write_report(HolderCase *root, T &&t)
     {
         std::unique_lock lock{ mtx };
         cve.wait_for(lock, t);
 
-        fmt::print("x{:.10f}% curr~{:.10f}%@d{}   p{} q{} d{} m{:.3f}%\n",
+        fmt::print("x{:.10f}% curr~{:.10f}%@d{}   p{} a{} q{} d{} m{:.1f}+{:.1f}/{:.0f}MiB e{}\n",
                 100.0 * root->GetDanger() / root->TotalStates,
                 100.0 * c.front()->TotalStates / root->TotalStates,
                 c.front()->Depth,
                 g_Processed.load(),
+                g_Abandoned.load(),
                 c.size(),
                 g_MaxDepth.load(),
-                g_MemoryAvailPercent.load());
+                g_InflatedBytes.load() / 1048576.0,
+                g_DeflatedBytes.load() / 1048576.0,
+                g_MemoryBudget / 1048576.0,
+                g_Evicted.load());
 
         return !done();
     }
@@ -415,14 +612,19 @@ public:
 
 int main(int argc, char *argv[])
 {
-    if (argc < 2 || argc > 3)
+    if (argc < 2 || argc > 4)
     {
         std::cout << "Usage: " << argv[0]
-            << R"(FL@\[<I>,<J>\]-(NH|2|P|2P)-<W>-<H>-T<M>-(SFAR|SNR) [<nprocs>])"
+            << R"(FL@\[<I>,<J>\]-(NH|2|P|2P)-<W>-<H>-T<M>-(SFAR|SNR) [<nprocs> [<memory budget in MiB>]])"
             << std::endl;
         return 1;
     }
 
+    // default to half of the physical memory
+    g_MemoryBudget = argc < 4
+        ? static_cast<size_t>(get_phys_pages()) * sysconf(_SC_PAGESIZE) / 2
+        : std::strtoull(argv[3], nullptr, 10) * 1048576;
+
 #ifdef NDEBUG
     const bool is_tty = isatty(STDERR_FILENO);
     using namespace std::chrono_literals;
@@ -449,13 +651,13 @@ int main(int argc, char *argv[])
     queue.push(ac);
     queue.inited();
 
-    updateMemoryAvailPercent();
 #ifdef NDEBUG
     std::vector<std::thread> threads;
     threads.emplace_back([&]()
     {
-        while (queue.sleep_for(2s))
-            updateMemoryAvailPercent();
+        // leave some headroom so that we don't evict on every tick
+        while (queue.sleep_for(100ms))
+            queue.evict(g_MemoryBudget / 10 * 9);
     });
     threads.emplace_back([&]()
     {
@@ -469,6 +671,14 @@ int main(int argc, char *argv[])
             std::vector<PCase> buffer;
             for (PCase p; (p = queue.pop(first)); first = false)
             {
+                // some sibling of an ancestor has been proved better
+                if (p->IsAbandoned())
+                {
+                    p->Resolve();
+                    p->Deplete();
+                    continue;
+                }
+
                 g_Processed++;
 #ifndef NDEBUG
                 fmt::print("Queue {}, Root danger = {:8f}%\n", queue.size(), 100.0 * root->GetDanger() / root->TotalStates);
@@ -479,7 +689,7 @@ int main(int argc, char *argv[])
 #endif
 
                 std::vector<PCase> buffer;
-                for (PCase pp; (pp = p->CheckedFork());)
+                for (PCase pp; !p->IsAbandoned() && (pp = p->CheckedFork());)
                 {
 #ifndef NDEBUG
                     if (auto fc = dynamic_cast<ForkedCase *>(p); fc)
@@ -497,13 +707,21 @@ int main(int argc, char *argv[])
                     else
                         queue.push(pp);
                 }
+                p->Resolve();
                 p->Deplete();
                 // note: we must fully fork the previous
                 // before working on its children
                 for (auto pp : buffer)
                 {
+                    if (pp->IsAbandoned())
+                    {
+                        pp->Resolve();
+                        pp->Deplete();
+                        continue;
+                    }
+
                     g_Processed++;
-                    for (PCase ppp; (ppp = pp->CheckedFork());)
+                    for (PCase ppp; !pp->IsAbandoned() && (ppp = pp->CheckedFork());)
                     {
 #ifndef NDEBUG
                         fmt::print("    >>{1}  (@{0})\n",
@@ -512,6 +730,7 @@ int main(int argc, char *argv[])
 #endif
                         queue.push(ppp);
                     }
+                    pp->Resolve();
                     pp->Deplete();
                 }
             }
@@ -522,4 +741,5 @@ int main(int argc, char *argv[])
 #endif
 
     std::cout << root->GetDanger();
+    delete root;
 }
@@ -9,6 +9,7 @@
 #include <mutex>
 #include <stdexcept>
 #include <variant>
+#include <vector>
 #include <boost/heap/fibonacci_heap.hpp>
 
 struct BaseCase;
@@ -33,14 +34,28 @@ struct BaseCase
     unsigned Depth;
     int Duplication;
 
+    // set once the subtree can no longer affect the result
+    std::atomic<bool> Abandoned;
+
     [[nodiscard]] GameMgr &Game() { return *ThePGame(); }
     [[nodiscard]] PGame ThePGame();
-    BaseCase &Deflate();
-    virtual void Deplete() { m_Game = std::monostate{}; }
+    [[nodiscard]] bool IsInflated() const { return std::holds_alternative<PGame>(m_Game); }
+    // bytes accounted for the game, see SetGame
+    [[nodiscard]] size_t GetBytes() const { return m_Bytes; }
+    // base: snapshot of the case this one is forked from, if available
+    BaseCase &Deflate(std::shared_ptr<const std::string> base = {});
+    virtual void Deplete() { SetGame(std::monostate{}); m_Base.reset(); m_Snapshot.reset(); }
 
     virtual PCase Fork() = 0;
     PCase CheckedFork();
 
+    // check if this or any of its ancestors is Abandoned
+    [[nodiscard]] bool IsAbandoned() const;
+
+    // call this when done forking, or when skipping this case
+    // n: number of pending children / self to be marked as resolved
+    void Resolve(int n = 1);
+
     virtual bool IsHolder() const { return false; }
 
     virtual std::string ToString() const;
@@ -52,7 +67,29 @@ struct BaseCase
 #endif
 
 protected:
-    std::variant<std::monostate, std::string, PGame> m_Game;
+    using GameHolder = std::variant<std::monostate, std::string, PGame>;
+
+    // std::string: GameMgr::Deflate, delta-encoded against m_Base if set
+    GameHolder m_Game;
+    std::shared_ptr<const std::string> m_Base;
+    // GameMgr::Deflate of self, shared by children as their m_Base
+    std::shared_ptr<const std::string> m_Snapshot;
+
+    [[nodiscard]] const std::shared_ptr<const std::string> &Snapshot();
+
+    // number of unresolved children, plus one for self until Resolve()
+    std::atomic<int> m_Pending;
+
+    // called when self and all children are resolved
+    virtual void OnResolved() { if (parent) parent->Resolve(); }
+
+    // replace m_Game, keeping g_InflatedBytes / g_DeflatedBytes up-to-date
+    // Note: a GameMgr shared by several cases is counted once per case
+    void SetGame(GameHolder game);
+
+private:
+    // bytes accounted for m_Game
+    size_t m_Bytes;
 };
 
 struct ForkedCase : BaseCase
@@ -74,6 +111,7 @@ protected:
 };
 
 struct ActionCase;
+struct UnsafeCase;
 
 struct HolderCase : BaseCase
 {
@@ -90,6 +128,8 @@ private:
 
 public:
     using BaseCase::BaseCase;
+    // deletes the children, see ActionCase
+    ~HolderCase() override;
 
     using handle_t = decltype(m_Heap)::handle_type;
 
@@ -103,6 +143,9 @@ public:
 
     void ReportDanger(ActionCase *self, double v);
 
+    // called when the Danger of a child is exact
+    void ReportProved(ActionCase *self);
+
     auto GetDanger() const { return Danger; }
 
 protected:
@@ -112,21 +155,28 @@ protected:
     // range: 0 ~ TotalState
     // protected by mtx
     double Danger;
+
+    // the least Danger among all proved children
+    // any child reaching this bound is abandoned
+    // protected by mtx
+    double Proved = std::numeric_limits<double>::infinity();
+
+    // abandon self if it can't beat the best proved sibling
+    // return the number of children abandoned
+    // must be called with mtx held
+    int TryAbandon(ActionCase *self);
 };
 
 struct ActionCase : ForkedCase
 {
     ActionCase(PCase p, PGame g, int id);
+    ~ActionCase() override;
 
-#ifdef NDEBUG
-    virtual void Deplete() override
-    {
-        if (m_Degree)
-            BaseCase::Deplete();
-        else
-            delete this;
-    }
-#endif
+    // Note: ActionCase is referenced by parent->m_Heap until the end,
+    // so it is owned by its parent and deleted along with it
+
+    // take ownership of <c>, forked from self or from a SafeCase below
+    void Adopt(UnsafeCase *c);
 
     PCase Fork() override;
 
@@ -136,7 +186,16 @@ struct ActionCase : ForkedCase
 
     // accumulated danger; protected by parent->mtx
     double Danger;
+    // Danger is exact; protected by parent->mtx
+    bool IsProved;
     HolderCase::handle_t Handle;
+
+protected:
+    void OnResolved() override;
+
+private:
+    std::mutex m_AdoptMtx; // SafeCase below fork concurrently
+    std::vector<std::unique_ptr<UnsafeCase>> m_Adopted;
 };
 
 struct SafeCase : ForkedCase
@@ -144,6 +203,10 @@ struct SafeCase : ForkedCase
     SafeCase(PCase p, PGame g)
         : ForkedCase{ p, g, g->GetBestBlockList().front() } { }
 
+    // Note: SafeCase is the one node not owned by the tree: it forks its children under
+    // its own parent (see ForkedCase::Fork<true>), and nothing refers to it once depleted,
+    // so it is freed right away instead of piling up until the end.
+    // Debug builds keep it, so that the addresses printed stay unique.
 #ifdef NDEBUG
     virtual void Deplete() override { delete this; }
 #endif
@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <unistd.h>
+
+#include "facade.hpp"
+#include "GameMgr.h"
+#include "random.h"
+#include "ThreadPool.h"
+
+// a position saved by MineSweeperSolver -r, see record in main.cpp
+struct position {
+    std::string string;
+    uint64_t seed;
+    SolvingState max_depth;
+    bool shortcut;
+    double recorded; // s
+    std::string snapshot;
+};
+
+position load(const std::filesystem::path &path) {
+    std::ifstream fin{ path, std::ios::binary };
+    if (!fin)
+        throw std::runtime_error("cannot open");
+    position pos;
+    int depth;
+    long ns;
+    std::string line;
+    std::getline(fin, line);
+    std::istringstream ss{ line };
+    if (!(ss >> pos.string >> pos.seed >> depth >> pos.shortcut >> ns))
+        throw std::runtime_error("malformed header");
+    pos.max_depth = static_cast<SolvingState>(depth);
+    pos.recorded = static_cast<double>(ns) * 1e-9;
+    pos.snapshot.assign(std::istreambuf_iterator<char>{ fin }, std::istreambuf_iterator<char>{});
+    return pos;
+}
+
+static std::chrono::steady_clock::duration g_budget;
+static std::shared_ptr<ThreadPool> g_pool;
+
+// the drainer is only built on positions with few enough solutions, see GameMgr::WouldDrain
+bool drainable(const position &pos, const Configuration &cfg) {
+    if (cfg.Logic != LogicMethod::Full)
+        return false;
+    std::istringstream ss{ pos.snapshot };
+    GameMgr mgr{ ss, cfg };
+    mgr.Solve(SolvingState::Reduce | SolvingState::Overlap | SolvingState::Probability, false);
+    return mgr.WouldDrain();
+}
+
+// min and mean of <repeat> runs of <fn> on a freshly loaded game, in s
+template <typename F>
+nlohmann::json measure(const position &pos, const Configuration &cfg, int repeat, F fn) {
+    auto min = std::numeric_limits<double>::infinity(), sum = 0.0;
+    auto degraded = false;
+    for (auto i = 0; i < repeat; i++) {
+        std::istringstream ss{ pos.snapshot };
+        GameMgr mgr{ ss, cfg };
+        mgr.SetDeadline(Deadline{ g_budget });
+        mgr.SetThreadPool(g_pool);
+        auto begin = std::chrono::steady_clock::now();
+        fn(mgr);
+        auto s = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        min = std::min(min, s);
+        sum += s;
+        degraded |= mgr.GetDegraded();
+    }
+    return { { "min", min }, { "mean", sum / repeat }, { "degraded", degraded } };
+}
+
+int main(int argc, char *argv[]) {
+    const auto prog = argv[0];
+    auto usage = [prog] {
+        std::cout << "Usage: " << prog << R"( [-n <repeat>] [-d] [-t <budget>] [-j <threads>] <corpus or position>...)"
+                  << "\n  -n: time each position <repeat> times, default 1"
+                  << "\n  -d: also time GameMgr::EnableDrainer, where the config would drain (FL with -D<D> only)"
+                  << "\n  -t: seconds for each run before the solver degrades, default 60; see GameMgr::SetDeadline"
+                  << "\n  -j: evaluate heuristics on <threads> more threads, default 0; see GameMgr::SetThreadPool"
+                  << "\nOne result line per position, in s; the last line sums the minima up."
+                  << std::endl;
+        return 2;
+    };
+
+    auto repeat = 1;
+    auto drainer = false;
+    auto budget = 60.0;
+    auto threads = 0;
+    for (int opt; (opt = getopt(argc, argv, "n:dt:j:")) != -1;)
+        switch (opt) {
+            case 'n':
+                repeat = std::atoi(optarg);
+                if (repeat <= 0)
+                    return usage();
+                break;
+            case 'd':
+                drainer = true;
+                break;
+            case 't':
+                budget = std::atof(optarg);
+                if (!(budget > 0))
+                    return usage();
+                break;
+            case 'j':
+                threads = std::atoi(optarg);
+                if (threads < 0)
+                    return usage();
+                break;
+            default:
+                return usage();
+        }
+    if (optind == argc)
+        return usage();
+    if (threads > 0)
+        g_pool = std::make_shared<ThreadPool>(static_cast<unsigned>(threads));
+    g_budget = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>{ budget });
+
+    std::vector<std::filesystem::path> paths;
+    for (auto i = optind; i < argc; i++)
+        if (std::filesystem::is_directory(argv[i])) {
+            auto begin = paths.size();
+            for (auto &entry : std::filesystem::directory_iterator{ argv[i] })
+                if (entry.path().extension() == ".mws")
+                    paths.push_back(entry.path());
+            std::sort(paths.begin() + static_cast<long>(begin), paths.end());
+        } else {
+            paths.emplace_back(argv[i]);
+        }
+
+    // ties among heuristics are broken randomly
+    SeedEngine(0);
+
+    auto failed = false;
+    auto positions = 0;
+    auto total_solve = 0.0, total_drainer = 0.0;
+    for (auto &path : paths) {
+        try {
+            auto pos = load(path);
+            auto cfg = parse(pos.string.c_str());
+            cache(cfg);
+
+            nlohmann::json j;
+            j["file"] = path.string();
+            j["string"] = pos.string;
+            j["seed"] = pos.seed;
+            j["recorded"] = pos.recorded;
+            j["solve"] = measure(pos, cfg, repeat, [&](GameMgr &mgr) {
+                mgr.Solve(pos.max_depth, pos.shortcut);
+            });
+            total_solve += j["solve"]["min"].get<double>();
+            if (drainer && drainable(pos, cfg)) {
+                j["drainer"] = measure(pos, cfg, repeat, [](GameMgr &mgr) {
+                    mgr.EnableDrainer(true);
+                });
+                total_drainer += j["drainer"]["min"].get<double>();
+            }
+            positions++;
+            std::cout << j << std::endl;
+        } catch (std::exception &e) {
+            std::cerr << path.string() << ": " << e.what() << "\n";
+            failed = true;
+        }
+    }
+
+    nlohmann::json j;
+    j["positions"] = positions;
+    j["solve"] = total_solve;
+    if (drainer)
+        j["drainer"] = total_drainer;
+    std::cout << j << std::endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,141 @@
+#include "Snapshot.h"
+
+SnapshotWriter::SnapshotWriter(std::string &buf) : m_Buf(buf) { }
+
+void SnapshotWriter::Byte(uint8_t val)
+{
+    m_Buf.push_back(static_cast<char>(val));
+}
+
+void SnapshotWriter::Unsigned(uint64_t val)
+{
+    while (val >= 0x80)
+    {
+        Byte(static_cast<uint8_t>(val) | 0x80);
+        val >>= 7;
+    }
+    Byte(static_cast<uint8_t>(val));
+}
+
+void SnapshotWriter::Signed(int64_t val)
+{
+    Unsigned(static_cast<uint64_t>(val) << 1 ^ static_cast<uint64_t>(val >> 63));
+}
+
+void SnapshotWriter::Double(double val)
+{
+    Raw(&val, sizeof(val));
+}
+
+void SnapshotWriter::Raw(const void *ptr, size_t len)
+{
+    m_Buf.append(static_cast<const char *>(ptr), len);
+}
+
+SnapshotReader::SnapshotReader(std::string_view buf) : m_Buf(buf), m_Pos(0) { }
+
+uint8_t SnapshotReader::Byte()
+{
+    if (m_Pos >= m_Buf.size())
+        throw std::runtime_error("snapshot truncated");
+    return static_cast<uint8_t>(m_Buf[m_Pos++]);
+}
+
+uint64_t SnapshotReader::Unsigned()
+{
+    uint64_t val = 0;
+    for (auto shift = 0; shift < 64; shift += 7)
+    {
+        auto b = Byte();
+        val |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return val;
+    }
+    throw std::runtime_error("snapshot varint too long");
+}
+
+int64_t SnapshotReader::Signed()
+{
+    auto val = Unsigned();
+    return static_cast<int64_t>(val >> 1) ^ -static_cast<int64_t>(val & 1);
+}
+
+double SnapshotReader::Double()
+{
+    double val;
+    Raw(&val, sizeof(val));
+    return val;
+}
+
+void SnapshotReader::Raw(void *ptr, size_t len)
+{
+    if (m_Buf.size() - m_Pos < len)
+        throw std::runtime_error("snapshot truncated");
+    memcpy(ptr, m_Buf.data() + m_Pos, len);
+    m_Pos += len;
+}
+
+size_t SnapshotReader::Count()
+{
+    auto val = Unsigned();
+    if (val > m_Buf.size() - m_Pos)
+        throw std::runtime_error("snapshot count out of range");
+    return static_cast<size_t>(val);
+}
+
+bool SnapshotReader::Done() const
+{
+    return m_Pos == m_Buf.size();
+}
+
+/* Layout: <size of snap> { <zeros> <length> <length bytes of snap ^ base> }* */
+std::string DeltaEncode(std::string_view snap, std::string_view base)
+{
+    std::string delta;
+    SnapshotWriter sw{ delta };
+    sw.Unsigned(snap.size());
+
+    auto diff = [&](size_t i) -> char
+        {
+            return i < base.size() ? snap[i] ^ base[i] : snap[i];
+        };
+
+    for (size_t i = 0; i < snap.size();)
+    {
+        auto zeros = i;
+        while (zeros < snap.size() && !diff(zeros))
+            ++zeros;
+        if (zeros == snap.size())
+            break;
+
+        // a lone zero byte is cheaper to keep inside the literal
+        auto end = zeros;
+        while (end < snap.size() && (diff(end) || end + 1 < snap.size() && diff(end + 1)))
+            ++end;
+
+        sw.Unsigned(zeros - i);
+        sw.Unsigned(end - zeros);
+        for (auto j = zeros; j < end; ++j)
+            sw.Byte(static_cast<uint8_t>(diff(j)));
+        i = end;
+    }
+    return delta;
+}
+
+std::string DeltaDecode(std::string_view delta, std::string_view base)
+{
+    SnapshotReader sr{ delta };
+    std::string snap(sr.Unsigned(), '\0');
+    base.copy(snap.data(), MIN(base.size(), snap.size()));
+
+    for (size_t i = 0; !sr.Done();)
+    {
+        i += sr.Unsigned();
+        auto len = sr.Unsigned();
+        if (i + len > snap.size())
+            throw std::runtime_error("snapshot delta out of range");
+        for (auto end = i + len; i < end; ++i)
+            snap[i] ^= static_cast<char>(sr.Byte());
+    }
+    return snap;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "stdafx.h"
+#include <cstdint>
+#include <string_view>
+
+/* Append-only binary encoder used by GameMgr::Deflate and BasicSolver::Deflate
+ *
+ * Note: Integers are written as LEB128 varints; signed ones are zigzag-encoded.
+ * Note: Doubles are written verbatim, so snapshots are NOT portable across endianness.
+ */
+class
+    SnapshotWriter
+{
+public:
+    explicit SnapshotWriter(std::string &buf);
+
+    void Byte(uint8_t val);
+    void Unsigned(uint64_t val);
+    void Signed(int64_t val);
+    void Double(double val);
+    void Raw(const void *ptr, size_t len);
+
+private:
+    std::string &m_Buf;
+};
+
+/* Counterpart of SnapshotWriter
+ *
+ * Note: Throws std::runtime_error on malformed input.
+ */
+class
+    SnapshotReader
+{
+public:
+    explicit SnapshotReader(std::string_view buf);
+
+    [[nodiscard]] uint8_t Byte();
+    [[nodiscard]] uint64_t Unsigned();
+    [[nodiscard]] int64_t Signed();
+    [[nodiscard]] double Double();
+    void Raw(void *ptr, size_t len);
+    /* Unsigned, as the number of items to follow, each at least a byte long
+     * Note: Throws std::runtime_error if fewer bytes are left.
+     */
+    [[nodiscard]] size_t Count();
+
+    [[nodiscard]] bool Done() const;
+
+private:
+    std::string_view m_Buf;
+    size_t m_Pos;
+};
+
+/* XOR <snap> against <base>, and run-length encode the resulting zeros.
+ * Snapshots of a case and its parent share most of their bytes,
+ * so the result is usually a small fraction of <snap>.
+ */
+std::string DeltaEncode(std::string_view snap, std::string_view base);
+/* Reverse of DeltaEncode; <base> must be identical to the one used for encoding */
+std::string DeltaDecode(std::string_view delta, std::string_view base);
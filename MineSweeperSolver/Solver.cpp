@@ -1,28 +1,61 @@
 #include "Solver.h"
 #include <algorithm>
+#include "Arena.h"
 #include "BinomialHelper.h"
+#include <numeric>
+#include <optional>
+#include <span>
+#include "ThreadPool.h"
 
-static size_t Hash(const BlockSet &set);
+static size_t Hash(const std::pmr::vector<int> &set);
 
-Solver::Solver(size_t count) : BasicSolver(count) {}
+Solver::Solver(size_t count) : BasicSolver(count), m_DistCondQCache(ScratchResource()) {}
 
-Solver::Solver(size_t count, int mines) : BasicSolver(count, mines) {}
+Solver::Solver(size_t count, int mines) : BasicSolver(count, mines), m_DistCondQCache(ScratchResource()) {}
 
-Solver::Solver(const Solver &other) : BasicSolver(other) {}
+Solver::Solver(const Solver &other) : BasicSolver(other), m_DistCondQCache(ScratchResource()) {}
 
 Solver::~Solver()
 {
     ClearDistCondQCache();
 }
 
-bool Solver::Solve(SolvingState maxDepth, bool shortcut)
+void Solver::Reset(int mines)
 {
-    if (BasicSolver::Solve(maxDepth, shortcut))
-    {
+    ClearDistCondQCache();
+    BasicSolver::Reset(mines);
+}
+
+SolveStatus Solver::TrySolve(SolvingState maxDepth, bool shortcut)
+{
+    auto status = BasicSolver::TrySolve(maxDepth, shortcut);
+    if (status != SolveStatus::Unchanged)
         ClearDistCondQCache();
-        return true;
+    return status;
+}
+
+void Solver::Inflate(SnapshotReader &sr)
+{
+    ClearDistCondQCache();
+    BasicSolver::Inflate(sr);
+}
+
+size_t Solver::MemoryUsage() const
+{
+    auto bytes = [](const auto &vec) { return vec.capacity() * sizeof(vec[0]); };
+
+    auto sz = BasicSolver::MemoryUsage()
+        + bytes(m_DicT_Temp) + bytes(m_Cases_Temp);
+    for (auto &[hash, par] : m_DistCondQCache)
+    {
+        sz += sizeof(*par) + bytes(par->Sets1) + bytes(par->m_Halves)
+            + bytes(par->m_Dists) + bytes(par->m_SolutionStates) + bytes(par->m_States) + bytes(par->m_Result);
+        for (auto &dists : par->m_Dists)
+            sz += bytes(dists);
+        for (auto &states : par->m_SolutionStates)
+            sz += bytes(states);
     }
-    return false;
+    return sz;
 }
 
 const DistCondQParameters &Solver::GetDistInfo(const BlockSet &set, Block blk, int &min)
@@ -54,7 +87,7 @@ double Solver::UpperBoundCondQ(const BlockSet &set, Block blk)
     return UCondQ(PackParameters(set, blk, min)).m_UpperBound;
 }
 
-const std::vector<double> &Solver::DistributionCondQ(const BlockSet &set, Block blk, int &min)
+const std::pmr::vector<double> &Solver::DistributionCondQ(const BlockSet &set, Block blk, int &min)
 {
     return DistCondQ(PackParameters(set, blk, min)).m_Result;
 }
@@ -80,6 +113,109 @@ double Solver::QuantityCondQ(const BlockSet &set, Block blk)
     return q;
 }
 
+void Solver::Classify(const BlockSet &blocks, const std::vector<BlockSet> &neighbors, std::vector<size_t> &representatives) const
+{
+    // signature of blocks[i]: its set id, then the sorted set ids of its neighbors,
+    // which determines Set2ID and Sets1 of PackParameters
+    std::pmr::vector<int> sigs(ScratchResource());
+    std::pmr::vector<size_t> offsets(ScratchResource());
+    offsets.reserve(blocks.size() + 1);
+    for (auto blk : blocks)
+    {
+        offsets.push_back(sigs.size());
+        sigs.push_back(m_SetIDs[blk]);
+        auto begin = sigs.size();
+        for (auto b : neighbors[blk])
+            if (m_SetIDs[b] >= 0)
+                sigs.push_back(m_SetIDs[b]);
+        std::sort(sigs.begin() + begin, sigs.end());
+    }
+    offsets.push_back(sigs.size());
+    auto sig = [&sigs, &offsets](size_t i)
+        {
+            return std::span<const int>{ sigs.data() + offsets[i], sigs.data() + offsets[i + 1] };
+        };
+
+    std::pmr::vector<size_t> order(blocks.size(), ScratchResource());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&sig](size_t lhs, size_t rhs)
+        {
+            return std::ranges::lexicographical_compare(sig(lhs), sig(rhs));
+        });
+
+    representatives.resize(blocks.size());
+    for (size_t i = 0, rep = 0; i < order.size(); ++i)
+    {
+        if (i == 0 || !std::ranges::equal(sig(order[i - 1]), sig(order[i])))
+            rep = order[i];
+        representatives[order[i]] = rep;
+    }
+}
+
+void Solver::Prefetch(const BlockSet &blocks, const std::vector<BlockSet> &neighbors, HeuristicMethod method, ThreadPool &pool)
+{
+    switch (method)
+    {
+    case HeuristicMethod::MaxZeroProb:
+    case HeuristicMethod::MaxZerosProb:
+    case HeuristicMethod::MaxZerosExp:
+    case HeuristicMethod::MaxQuantityExp:
+    case HeuristicMethod::MaxUpperBound:
+        break;
+    default:
+        return;
+    }
+
+    auto cached = [this](const DistCondQParameters &par)
+        {
+            auto itp = m_DistCondQCache.equal_range(par.m_Hash);
+            for (auto it = itp.first; it != itp.second; ++it)
+                if (*it->second == par)
+                    return true;
+            return false;
+        };
+
+    BlockSet todo;
+    for (auto blk : blocks)
+    {
+        int min;
+        if (!cached(PackParameters(neighbors[blk], blk, min)))
+            todo.push_back(blk);
+    }
+    if (todo.size() <= 1)
+        return;
+
+    // the workers only read the solver, and build the parameters on their own;
+    // the cache is filled afterwards on this thread
+    std::vector<std::optional<DistCondQParameters>> results(todo.size());
+    pool.ParallelFor(todo.size(), [&](size_t i)
+        {
+            int min;
+            auto &par = results[i].emplace(PackParameters(neighbors[todo[i]], todo[i], min));
+            if (method == HeuristicMethod::MaxZeroProb)
+            {
+                ComputeZ(par);
+                return;
+            }
+            GetHalves(par);
+            if (method == HeuristicMethod::MaxQuantityExp)
+            {
+                ConvolveSolutions(par);
+                return;
+            }
+            EnumerateSolutions(par);
+            ComputeU(par);
+        });
+
+    std::pmr::polymorphic_allocator<> alloc{ m_DistCondQCache.get_allocator() };
+    for (auto &par : results)
+        if (!cached(*par))
+        {
+            auto ptr = alloc.new_object<DistCondQParameters>(std::move(*par));
+            m_DistCondQCache.insert(std::make_pair(ptr->m_Hash, ptr));
+        }
+}
+
 void Solver::Merge(const std::vector<double> &from, std::vector<double> &to)
 {
     ASSERT(from.size() <= to.size());
@@ -87,9 +223,9 @@ void Solver::Merge(const std::vector<double> &from, std::vector<double> &to)
         to[i] += from[i];
 }
 
-void Solver::Add(std::vector<double> &from, const std::vector<double> &cases)
+void Solver::Add(std::pmr::vector<double> &from, const std::pmr::vector<double> &cases, std::pmr::vector<double> &temp)
 {
-    auto &dicN = m_Add_Temp;
+    auto &dicN = temp;
     dicN.clear() , dicN.resize(from.size() + cases.size() - 1, 0);
     for (auto i = 0; i < from.size(); ++i)
         for (auto j = 0; j < cases.size(); ++j)
@@ -122,10 +258,13 @@ void Solver::EnumerateSolutions(DistCondQParameters &par) const
 {
     par.m_States.clear();
     par.m_States.resize(par.Length + 1, 0);
-    par.m_Solutions.clear();
-    par.m_Solutions.resize(par.Length + 1);
+    par.m_Dists.clear();
+    par.m_Dists.resize(par.Length + 1);
+    par.m_SolutionStates.clear();
+    par.m_SolutionStates.resize(par.Length + 1);
 
-    std::vector<int> stack, lb, ub;
+    std::pmr::vector<int> stack(ScratchResource()), lb(ScratchResource()), ub(ScratchResource());
+    std::pmr::vector<int> dist(par.Sets1.size() + par.m_Halves.size(), ScratchResource());
 #ifndef NDEBUG
     if (m_Solutions.empty())
         throw std::runtime_error("m_Solution is empty when trying to enumerate dist");
@@ -152,7 +291,6 @@ void Solver::EnumerateSolutions(DistCondQParameters &par) const
                 {
                     auto val = 0;
                     double st = 1;
-                    std::vector<int> dist(par.Sets1.size() + par.m_Halves.size());
                     for (auto i = 0, p = 0; i < par.Sets1.size(); ++i)
                     {
                         if (p < par.m_Halves.size() && i == par.m_Halves[p])
@@ -174,9 +312,8 @@ void Solver::EnumerateSolutions(DistCondQParameters &par) const
                     if (st > 0)
                     {
                         par.m_States[val] += st;
-                        par.m_Solutions[val].emplace_back();
-                        par.m_Solutions[val].back().Dist.swap(dist);
-                        par.m_Solutions[val].back().States = st;
+                        par.m_Dists[val].insert(par.m_Dists[val].end(), dist.begin(), dist.end());
+                        par.m_SolutionStates[val].push_back(st);
                     }
 
                     if (par.m_Halves.empty())
@@ -201,6 +338,68 @@ void Solver::EnumerateSolutions(DistCondQParameters &par) const
             }
     }
 
+    Normalize(par);
+}
+
+void Solver::ConvolveSolutions(DistCondQParameters &par) const
+{
+    par.m_States.clear();
+    par.m_States.resize(par.Length + 1, 0);
+    par.m_Dists.clear();
+    par.m_SolutionStates.clear();
+
+    // dic[k]: number of states with <val> + k mines in the neighbor
+    std::pmr::vector<double> dic(ScratchResource()), cases(ScratchResource()), temp(ScratchResource());
+#ifndef NDEBUG
+    if (m_Solutions.empty())
+        throw std::runtime_error("m_Solution is empty when trying to enumerate dist");
+#endif
+    for (auto &solution : m_Solutions)
+    {
+        if (par.Set2ID > 0 && m_BlockSets[par.Set2ID].size() == solution.Dist[par.Set2ID])
+            continue;
+
+        auto val = 0;
+        double st = 1;
+        dic.assign(1, 1);
+        for (auto i = 0, p = 0; i < par.Sets1.size(); ++i)
+        {
+            if (p < par.m_Halves.size() && i == par.m_Halves[p])
+            {
+                // the mines of the set are split between the two halves, see EnumerateSolutions
+                auto rest = static_cast<int>(m_BlockSets[i].size()) - (i == par.Set2ID ? 1 : 0) - par.Sets1[i];
+                auto lb = MAX(static_cast<int>(solution.Dist[i]) - rest, 0);
+                auto ub = MIN(solution.Dist[i], par.Sets1[i]);
+                if (lb > ub)
+                {
+                    st = 0;
+                    break;
+                }
+                cases.clear();
+                for (auto k = lb; k <= ub; ++k)
+                    cases.push_back(Binomial(par.Sets1[i], k) * Binomial(rest, solution.Dist[i] - k));
+                Add(dic, cases, temp);
+                val += lb;
+                ++p;
+            }
+            else
+            {
+                st *= Binomial(m_BlockSets[i].size() - (i == par.Set2ID ? 1 : 0), solution.Dist[i]);
+                if (par.Sets1[i] != 0)
+                    val += solution.Dist[i];
+            }
+        }
+        if (st <= 0)
+            continue;
+        for (auto k = 0; k < dic.size(); ++k)
+            par.m_States[val + k] += st * dic[k];
+    }
+
+    Normalize(par);
+}
+
+void Solver::Normalize(DistCondQParameters &par)
+{
     par.m_TotalStates = 0;
     for (auto val : par.m_States)
         par.m_TotalStates += val;
@@ -226,7 +425,7 @@ DistCondQParameters *Solver::TryGetCache(DistCondQParameters &&par, std::functio
     }
     if (ptr == nullptr)
     {
-        ptr = new DistCondQParameters(std::move(par));
+        ptr = std::pmr::polymorphic_allocator<>{ m_DistCondQCache.get_allocator() }.new_object<DistCondQParameters>(std::move(par));
         m_DistCondQCache.insert(std::make_pair(ptr->m_Hash, ptr));
     }
     return ptr;
@@ -242,6 +441,12 @@ const DistCondQParameters &Solver::ZCondQ(DistCondQParameters &&par)
     if (pre(*ptr))
         return *ptr;
 
+    ComputeZ(*ptr);
+    return *ptr;
+}
+
+void Solver::ComputeZ(DistCondQParameters &par) const
+{
     double val = 0;
     for (auto &solution : m_Solutions)
     {
@@ -249,15 +454,14 @@ const DistCondQParameters &Solver::ZCondQ(DistCondQParameters &&par)
         for (auto i = 0; i < m_BlockSets.size(); ++i)
         {
             auto n = m_BlockSets[i].size();
-            auto a = ptr->Sets1[i], b = i == ptr->Set2ID ? 1 : 0;
+            auto a = par.Sets1[i], b = i == par.Set2ID ? 1 : 0;
             auto m = solution.Dist[i];
 
             valT *= Binomial(n - a - b, m);
         }
         val += valT;
     }
-    ptr->m_Result.push_back(val);
-    return *ptr;
+    par.m_Result.push_back(val);
 }
 
 const DistCondQParameters &Solver::DistCondQ(DistCondQParameters &&par)
@@ -271,7 +475,7 @@ const DistCondQParameters &Solver::DistCondQ(DistCondQParameters &&par)
         return *ptr;
 
     GetHalves(*ptr);
-    EnumerateSolutions(*ptr);
+    ConvolveSolutions(*ptr);
     return *ptr;
 }
 
@@ -287,40 +491,49 @@ const DistCondQParameters &Solver::UCondQ(DistCondQParameters &&par)
 
     GetHalves(*ptr);
     EnumerateSolutions(*ptr);
+    ComputeU(*ptr);
+    return *ptr;
+}
 
-    ptr->m_Probability = 0;
-    ptr->m_Expectation = 0;
-    ptr->m_UpperBound = 0;
-    std::vector<int> zero;
-    std::vector<double> upper;
-    for (auto i = 0; i <= ptr->Length; ++i)
+void Solver::ComputeU(DistCondQParameters &par) const
+{
+    par.m_Probability = 0;
+    par.m_Expectation = 0;
+    par.m_UpperBound = 0;
+    auto width = par.Sets1.size() + par.m_Halves.size();
+    std::pmr::vector<int> zero(ScratchResource());
+    std::pmr::vector<double> upper(ScratchResource());
+    for (auto i = 0; i <= par.Length; ++i)
     {
-        if (ptr->m_Solutions[i].empty())
+        if (par.m_SolutionStates[i].empty())
             continue;
 
         zero.clear();
-        zero.resize(ptr->Sets1.size() + ptr->m_Halves.size(), 1);
+        zero.resize(width, 1);
         upper.clear();
-        upper.resize(ptr->Sets1.size() + ptr->m_Halves.size(), 0);
-        for (auto j = 0; j < ptr->m_Solutions[i].size(); ++j)
-            for (auto k = 0; k < ptr->Sets1.size() + ptr->m_Halves.size(); ++k)
-                if (ptr->m_Solutions[i][j].Dist[k] != 0)
+        upper.resize(width, 0);
+        for (auto j = 0; j < par.m_SolutionStates[i].size(); ++j)
+        {
+            auto dist = &par.m_Dists[i][j * width];
+            for (auto k = 0; k < width; ++k)
+                if (dist[k] != 0)
                 {
                     zero[k] = 0;
-                    upper[k] += ptr->m_Solutions[i][j].Dist[k] * ptr->m_Solutions[i][j].States;
+                    upper[k] += dist[k] * par.m_SolutionStates[i][j];
                 }
+        }
 
         auto totalBlanks = 0;
         auto p = 0;
-        for (auto j = 0; j < ptr->Sets1.size(); ++j)
+        for (auto j = 0; j < par.Sets1.size(); ++j)
         {
-            while (p < ptr->m_Halves.size() && j > ptr->m_Halves[p])
+            while (p < par.m_Halves.size() && j > par.m_Halves[p])
                 ++p;
 
             int size;
-            if (p < ptr->m_Halves.size() && j == ptr->m_Halves[p])
+            if (p < par.m_Halves.size() && j == par.m_Halves[p])
             {
-                size = ptr->Sets1[j];
+                size = par.Sets1[j];
                 ++p;
             }
             else
@@ -333,10 +546,10 @@ const DistCondQParameters &Solver::UCondQ(DistCondQParameters &&par)
             else
                 upper[j] /= size;
         }
-        for (auto j = ptr->Sets1.size(); j < ptr->Sets1.size() + ptr->m_Halves.size(); ++j)
+        for (auto j = par.Sets1.size(); j < par.Sets1.size() + par.m_Halves.size(); ++j)
         {
-            auto size = m_BlockSets[j - ptr->Sets1.size()].size() - ptr->Sets1[j - ptr->Sets1.size()];
-            if (j == ptr->Sets1.size() + ptr->Set2ID)
+            auto size = m_BlockSets[j - par.Sets1.size()].size() - par.Sets1[j - par.Sets1.size()];
+            if (j == par.Sets1.size() + par.Set2ID)
                 --size;
 
             if (zero[j] == 1)
@@ -347,8 +560,8 @@ const DistCondQParameters &Solver::UCondQ(DistCondQParameters &&par)
 
         if (totalBlanks != 0)
         {
-            ptr->m_Probability += ptr->m_Result[i];
-            ptr->m_Expectation += ptr->m_Result[i] * totalBlanks;
+            par.m_Probability += par.m_Result[i];
+            par.m_Expectation += par.m_Result[i] * totalBlanks;
             continue;
         }
 
@@ -357,11 +570,10 @@ const DistCondQParameters &Solver::UCondQ(DistCondQParameters &&par)
             if (u < bound)
                 bound = u;
 
-        ptr->m_UpperBound += bound;
+        par.m_UpperBound += bound;
     }
 
-    ptr->m_UpperBound = 1 - ptr->m_UpperBound / ptr->m_TotalStates;
-    return *ptr;
+    par.m_UpperBound = 1 - par.m_UpperBound / par.m_TotalStates;
 }
 
 void Solver::ClearDistCondQCache()
@@ -370,15 +582,15 @@ void Solver::ClearDistCondQCache()
     {
         if (cache.second == nullptr)
             continue;
-        delete cache.second;
+        std::pmr::polymorphic_allocator<>{ m_DistCondQCache.get_allocator() }.delete_object(cache.second);
         cache.second = nullptr;
     }
     m_DistCondQCache.clear();
 }
 
-DistCondQParameters::DistCondQParameters(DistCondQParameters &&other) noexcept : Sets1(std::move(other.Sets1)), Set2ID(other.Set2ID), Length(other.Length), m_Hash(other.m_Hash), m_Halves(std::move(other.m_Halves)), m_Result(std::move(other.m_Result)), m_Probability(other.m_Probability), m_Expectation(other.m_Expectation), m_UpperBound(other.m_UpperBound), m_TotalStates(other.m_TotalStates) {}
+DistCondQParameters::DistCondQParameters(DistCondQParameters &&other) noexcept : Sets1(std::move(other.Sets1)), Set2ID(other.Set2ID), Length(other.Length), m_Hash(other.m_Hash), m_Halves(std::move(other.m_Halves)), m_Dists(Sets1.get_allocator()), m_SolutionStates(Sets1.get_allocator()), m_States(Sets1.get_allocator()), m_Result(std::move(other.m_Result)), m_Probability(other.m_Probability), m_Expectation(other.m_Expectation), m_UpperBound(other.m_UpperBound), m_TotalStates(other.m_TotalStates) {}
 
-DistCondQParameters::DistCondQParameters(Block set2ID, int length) : Set2ID(set2ID), Length(length), m_Hash(Hash()), m_Probability(NAN), m_Expectation(NAN), m_UpperBound(NAN), m_TotalStates(NAN) {}
+DistCondQParameters::DistCondQParameters(Block set2ID, int length) : Sets1(ScratchResource()), Set2ID(set2ID), Length(length), m_Hash(Hash()), m_Halves(ScratchResource()), m_Dists(ScratchResource()), m_SolutionStates(ScratchResource()), m_States(ScratchResource()), m_Result(ScratchResource()), m_Probability(NAN), m_Expectation(NAN), m_UpperBound(NAN), m_TotalStates(NAN) {}
 
 size_t DistCondQParameters::Hash()
 {
@@ -414,7 +626,7 @@ bool operator<(const DistCondQParameters &lhs, const DistCondQParameters &rhs)
     return false;
 }
 
-size_t Hash(const BlockSet &set)
+size_t Hash(const std::pmr::vector<int> &set)
 {
     size_t hash = 5381;
     for (auto v : set)
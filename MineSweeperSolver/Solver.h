@@ -1,10 +1,13 @@
 #pragma once
 #include "stdafx.h"
 #include "BasicSolver.h"
+#include "Strategies.h"
 #include <map>
+#include <memory_resource>
 #include <functional>
 
 class DistCondQParameters;
+class ThreadPool;
 
 /* Compute some heuristic information about blocks that helps break the tie when can't decide next move.
  *
@@ -20,7 +23,11 @@ public:
     Solver(const Solver &other);
     ~Solver() override;
 
-    bool Solve(SolvingState maxDepth, bool shortcut) override;
+    void Reset(int mines) override;
+
+    [[nodiscard]] SolveStatus TrySolve(SolvingState maxDepth, bool shortcut) override;
+    void Inflate(SnapshotReader &sr) override;
+    [[nodiscard]] size_t MemoryUsage() const override;
 
     [[nodiscard]] const DistCondQParameters &GetDistInfo(const BlockSet &set, Block blk, int &min);
 
@@ -28,19 +35,34 @@ public:
     [[nodiscard]] double ZerosCondQ(const BlockSet &set, Block blk);
     [[nodiscard]] double ZerosECondQ(const BlockSet &set, Block blk);
     [[nodiscard]] double UpperBoundCondQ(const BlockSet &set, Block blk);
-    [[nodiscard]] const std::vector<double> &DistributionCondQ(const BlockSet &set, Block blk, int &min);
+    [[nodiscard]] const std::pmr::vector<double> &DistributionCondQ(const BlockSet &set, Block blk, int &min);
     [[nodiscard]] double QuantityCondQ(const BlockSet &set, Block blk);
 
+    /* Group <blocks> by their set and the sets of their neighbors <neighbors>[blk],
+     * so that every *CondQ above is the same within a group
+     *
+     * OUT representatives[i]: the first j such that blocks[j] is in the same group as blocks[i]
+     */
+    void Classify(const BlockSet &blocks, const std::vector<BlockSet> &neighbors, std::vector<size_t> &representatives) const;
+
+    /* Fill the cache for each of <blocks> on <pool>, as <method> would, with <neighbors>[blk] as the set
+     *
+     * Note: Nothing is done for methods not relying on the cache.
+     * Note: <blocks> shall be of distinct groups of Classify, or some work is repeated.
+     */
+    void Prefetch(const BlockSet &blocks, const std::vector<BlockSet> &neighbors, HeuristicMethod method, ThreadPool &pool);
+
     friend class Drainer;
 private:
-    std::multimap<size_t, DistCondQParameters *> m_DistCondQCache;
+    // allocated from the ScratchResource() at construction, as are the parameters
+    std::pmr::multimap<size_t, DistCondQParameters *> m_DistCondQCache;
 
     std::vector<double> m_DicT_Temp, m_Cases_Temp;
-    std::vector<double> m_Add_Temp;
 
 
     static void Merge(const std::vector<double> &from, std::vector<double> &to);
-    void Add(std::vector<double> &from, const std::vector<double> &cases);
+    /* <from> := <from> * <cases> as polynomials, with <temp> as scratch */
+    static void Add(std::pmr::vector<double> &from, const std::pmr::vector<double> &cases, std::pmr::vector<double> &temp);
 
     /* Prepare for distribution computation
      *
@@ -52,8 +74,18 @@ private:
 
     /* Compute <par>.m_Halves */
     void GetHalves(DistCondQParameters &par) const;
-    /* Actually compute the distribution */
+    /* Actually compute the distribution, and keep each solution in <par>.m_Dists */
     void EnumerateSolutions(DistCondQParameters &par) const;
+    /* Same as above, but only the distribution: the halves are convolved
+     * instead of enumerated, and <par>.m_Dists is left empty
+     */
+    void ConvolveSolutions(DistCondQParameters &par) const;
+    /* <par>.m_TotalStates and <par>.m_Result from <par>.m_States */
+    static void Normalize(DistCondQParameters &par);
+    /* What ZCondQ computes, without the cache */
+    void ComputeZ(DistCondQParameters &par) const;
+    /* What UCondQ computes after EnumerateSolutions, without the cache */
+    void ComputeU(DistCondQParameters &par) const;
 
     [[nodiscard]] DistCondQParameters *TryGetCache(DistCondQParameters &&par, std::function<bool(const DistCondQParameters &)> pre);
 
@@ -69,6 +101,8 @@ private:
 /* Distribution of the degree of a block
  *
  * Note: This class only stores data; computation happens in class Solver
+ *
+ * Note: Its containers are allocated from the ScratchResource() at construction.
  */
 class
     DistCondQParameters
@@ -78,7 +112,7 @@ public:
     DistCondQParameters(Block set2ID, int length);
 
     // [i] = num of shared blocks b/w the block's neighbor and m_BlockSets[i]
-    std::vector<int> Sets1;
+    std::pmr::vector<int> Sets1;
     int Set2ID; // id such that m_BlockSets[<Set2ID>] contains the block
     int Length; // sum of <sets1>
 
@@ -92,12 +126,16 @@ public:
     /* List of ids that m_BlockSets[<m_Halves[i]>] is split in two halves
      * by the block's neighbor: one half is of size Sets1[<m_Halves[i]>]
      */
-    std::vector<int> m_Halves;
-    std::vector<std::vector<Solution>> m_Solutions;
-    std::vector<double> m_States;
+    std::pmr::vector<int> m_Halves;
+    /* Solutions with the degree being i: m_Dists[i] holds Sets1.size() + m_Halves.size()
+     * mine counts for each, and m_SolutionStates[i] its number of states
+     */
+    std::pmr::vector<std::pmr::vector<int>> m_Dists;
+    std::pmr::vector<std::pmr::vector<double>> m_SolutionStates;
+    std::pmr::vector<double> m_States;
 
     /* The probability of each individual degree number */
-    std::vector<double> m_Result;
+    std::pmr::vector<double> m_Result;
 
     /* These data are only set by UCondQ
      * m_Probability: E(<at-least-one-safe-block>)
@@ -22,7 +22,8 @@ enum class HeuristicMethod
     MaxQuantityExp = 0x05,
     MinFrontierDist = 0x06,
     MaxUpperBound = 0x07,
-    Relevant2 = 0x08
+    Relevant2 = 0x08,
+    MaxLookahead = 0x09 // expensive, see GameMgr::Lookahead
 };
 
 struct Strategy
@@ -38,4 +39,6 @@ struct Strategy
     bool ExhaustEnabled, PruningEnabled;
     int ExhaustCriterion, PruningCriterion;
     std::vector<HeuristicMethod> PruningDecisionTree;
+
+    bool operator==(const Strategy &) const = default;
 };
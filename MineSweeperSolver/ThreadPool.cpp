@@ -0,0 +1,115 @@
+#include "ThreadPool.h"
+
+#ifndef __EMSCRIPTEN__
+
+ThreadPool::ThreadPool(unsigned threads) : m_Job(nullptr), m_Count(0), m_Next(0), m_Generation(0), m_Busy(0), m_Stopping(false)
+{
+    m_Workers.reserve(threads);
+    for (auto i = 0; i < threads; ++i)
+        m_Workers.emplace_back(&ThreadPool::Work, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock{ m_Mutex };
+        m_Stopping = true;
+    }
+    m_Wake.notify_all();
+    for (auto &th : m_Workers)
+        th.join();
+}
+
+unsigned ThreadPool::GetThreads() const
+{
+    return static_cast<unsigned>(m_Workers.size());
+}
+
+void ThreadPool::ParallelFor(size_t n, const std::function<void(size_t)> &fun)
+{
+    if (m_Workers.empty() || n <= 1)
+    {
+        for (size_t i = 0; i < n; ++i)
+            fun(i);
+        return;
+    }
+
+    std::lock_guard serial{ m_Serial };
+    {
+        std::lock_guard lock{ m_Mutex };
+        m_Job = &fun;
+        m_Count = n;
+        m_Next = 0;
+        m_Error = nullptr;
+        m_Busy = static_cast<unsigned>(m_Workers.size());
+        ++m_Generation;
+    }
+    m_Wake.notify_all();
+    Drain();
+
+    std::exception_ptr error;
+    {
+        std::unique_lock lock{ m_Mutex };
+        m_Done.wait(lock, [this] { return m_Busy == 0; });
+        m_Job = nullptr;
+        error = m_Error;
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+void ThreadPool::Work()
+{
+    size_t seen = 0;
+    while (true)
+    {
+        {
+            std::unique_lock lock{ m_Mutex };
+            m_Wake.wait(lock, [this, seen] { return m_Stopping || m_Generation != seen; });
+            if (m_Stopping)
+                return;
+            seen = m_Generation;
+        }
+        Drain();
+        {
+            std::lock_guard lock{ m_Mutex };
+            if (--m_Busy == 0)
+                m_Done.notify_one();
+        }
+    }
+}
+
+void ThreadPool::Drain()
+{
+    for (size_t i; (i = m_Next++) < m_Count;)
+        try
+        {
+            (*m_Job)(i);
+        }
+        catch (...)
+        {
+            std::lock_guard lock{ m_Mutex };
+            if (!m_Error)
+                m_Error = std::current_exception();
+            m_Next = m_Count;
+        }
+}
+
+#else // __EMSCRIPTEN__
+
+ThreadPool::ThreadPool(unsigned threads) { }
+
+ThreadPool::~ThreadPool() = default;
+
+unsigned ThreadPool::GetThreads() const
+{
+    return 0;
+}
+
+void ThreadPool::ParallelFor(size_t n, const std::function<void(size_t)> &fun)
+{
+    for (size_t i = 0; i < n; ++i)
+        fun(i);
+}
+
+#endif // __EMSCRIPTEN__
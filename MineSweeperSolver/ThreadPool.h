@@ -0,0 +1,57 @@
+#pragma once
+#include "stdafx.h"
+#include <functional>
+
+#ifndef __EMSCRIPTEN__
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#endif // __EMSCRIPTEN__
+
+/* Fixed set of worker threads to split a loop across
+ *
+ * Note: With __EMSCRIPTEN__ there are no workers, and everything runs on the calling thread.
+ */
+class
+    ThreadPool
+{
+public:
+    /* <threads> workers besides the calling thread */
+    explicit ThreadPool(unsigned threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /* Number of workers besides the calling thread */
+    [[nodiscard]] unsigned GetThreads() const;
+
+    /* Call <fun>(i) for each i in [0, <n>) on the workers and the calling thread, and wait for all of them
+     *
+     * Note: The first exception thrown by <fun> is rethrown here; indices not yet started are skipped.
+     * Note: Concurrent calls are run one after another.
+     * Note: The workers have no CurrentArena, CurrentProfile nor CurrentRecorder.
+     */
+    void ParallelFor(size_t n, const std::function<void(size_t)> &fun);
+
+private:
+#ifndef __EMSCRIPTEN__
+    std::vector<std::thread> m_Workers;
+    std::mutex m_Serial; // held by the running ParallelFor
+
+    std::mutex m_Mutex; // guards everything below but m_Next
+    std::condition_variable m_Wake, m_Done;
+    const std::function<void(size_t)> *m_Job;
+    size_t m_Count;
+    std::atomic<size_t> m_Next;
+    size_t m_Generation; // one per ParallelFor
+    unsigned m_Busy; // workers yet to finish the current generation
+    bool m_Stopping;
+    std::exception_ptr m_Error;
+
+    void Work();
+    void Drain();
+#endif // __EMSCRIPTEN__
+};
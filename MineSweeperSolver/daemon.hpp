@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* Protocol of MineSweeperDaemon over a Unix domain socket.
+ *
+ * Every request and every reply is a frame: a uint32 length of what follows,
+ * an opcode (request) or a status (reply) byte, then the body.
+ * Numbers are in host byte order, as both ends are on the same host.
+ *
+ * One connection is one session, holding one game; sessions are served concurrently.
+ */
+enum class daemon_op : uint8_t {
+    // body: uint16 length and a configuration string, see parse(),
+    //   then a position by GameMgr::Deflate(), or nothing for a new game
+    // reply: int32 width, height, mines, blocks to open
+    load = 1,
+    // body: uint32 budget in microseconds, 0 for none
+    // reply: uint32 SolvingState reached, see GameMgr::Solve, then a double per block: probability of mine
+    solve = 2,
+    // body: int32 block (x * height + y)
+    // reply: uint8 started, uint8 succeed, int32 blocks to open
+    click = 3,
+    // body: uint32 budget in microseconds, 0 for none
+    // reply: uint32 SolvingState reached, int32 block to click, or -1 if none
+    best = 4,
+};
+
+enum class daemon_status : uint8_t {
+    ok = 0,
+    error = 1, // body: message
+};
+
+// frames beyond this are refused, so that a broken peer does not take the memory
+static constexpr uint32_t DAEMON_MAX_FRAME = 1u << 24;
+// boards beyond this many blocks are refused, so that a peer does not make the binomials take the memory
+static constexpr int DAEMON_MAX_BLOCKS = 1 << 16;
+
+template <typename T>
+void put(std::string &buf, T v) {
+    buf.append(reinterpret_cast<const char *>(&v), sizeof(T));
+}
+
+template <typename T>
+T get(std::string_view &buf) {
+    if (buf.size() < sizeof(T))
+        throw std::runtime_error("frame is truncated");
+    T v;
+    std::memcpy(&v, buf.data(), sizeof(T));
+    buf.remove_prefix(sizeof(T));
+    return v;
+}
+
+inline bool read_all(int fd, char *p, size_t n) {
+    while (n) {
+        auto r = read(fd, p, n);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        p += r, n -= r;
+    }
+    return true;
+}
+
+inline bool write_all(int fd, const char *p, size_t n) {
+    while (n) {
+        auto r = send(fd, p, n, MSG_NOSIGNAL);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        p += r, n -= r;
+    }
+    return true;
+}
+
+// false once the peer is gone or misbehaves
+inline bool read_frame(int fd, std::string &frame) {
+    uint32_t len;
+    if (!read_all(fd, reinterpret_cast<char *>(&len), sizeof(len)) || len == 0 || len > DAEMON_MAX_FRAME)
+        return false;
+    frame.resize(len);
+    return read_all(fd, frame.data(), len);
+}
+
+// opcode or status first; the length is filled in by write_frame
+template <typename E>
+std::string begin_frame(E head) {
+    std::string frame(sizeof(uint32_t), '\0');
+    put(frame, head);
+    return frame;
+}
+
+// <frame> is from begin_frame
+inline bool write_frame(int fd, std::string &frame) {
+    auto len = static_cast<uint32_t>(frame.size() - sizeof(uint32_t));
+    std::memcpy(frame.data(), &len, sizeof(len));
+    return write_all(fd, frame.data(), frame.size());
+}
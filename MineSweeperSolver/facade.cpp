@@ -1,7 +1,9 @@
 #include "facade.hpp"
 
+#include <optional>
 #include <sstream>
 
+#include "Arena.h"
 #include "GameMgr.h"
 #include "BinomialHelper.h"
 
@@ -100,6 +102,9 @@ Configuration parse(const char *hsh)
             case '2':
                 st.DecisionTree.push_back(HeuristicMethod::Relevant2);
                 break;
+            case 'L':
+                st.DecisionTree.push_back(HeuristicMethod::MaxLookahead);
+                break;
             default:
                 break;
         }
@@ -148,11 +153,101 @@ Configuration parse(const char *hsh)
     return cfg;
 }
 
+/* The game of the current thread, reused by each run of the same size, see GameMgr::Reset
+ *
+ * Note: It is reset after each game rather than before, so that
+ * it never holds scratch from the CurrentArena in between.
+ */
+static thread_local std::optional<GameMgr> Pooled;
+
+static GameMgr &Acquire(const Configuration &cfg)
+{
+    if (!Pooled || Pooled->GetTotalWidth() != cfg.Width || Pooled->GetTotalHeight() != cfg.Height ||
+        Pooled->GetTotalMines() != cfg.TotalMines || Pooled->GetSNR() != cfg.IsSNR)
+    {
+        Pooled.reset();
+        if (CurrentArena)
+            CurrentArena->Reset();
+        return Pooled.emplace(cfg.Width, cfg.Height, cfg.TotalMines, cfg.IsSNR, cfg, false);
+    }
+    if (!(Pooled->BasicStrategy == cfg))
+    {
+        Pooled->BasicStrategy = cfg;
+        Pooled->Reset();
+    }
+    if (CurrentArena)
+        CurrentArena->Reset();
+    return *Pooled;
+}
+
+template <typename F>
+static auto Play(const Configuration &cfg, F fun)
+{
+    auto &mgr = Acquire(cfg);
+    try
+    {
+        auto res = fun(mgr);
+        mgr.Reset();
+        return res;
+    }
+    catch (...)
+    {
+        Pooled.reset();
+        throw;
+    }
+}
+
 bool run(const Configuration &Config)
 {
-    GameMgr mgr(Config.Width, Config.Height, Config.TotalMines, Config.IsSNR, Config, false);
-    mgr.Automatic();
-    return mgr.GetSucceed();
+    bool degraded;
+    return run(Config, std::chrono::steady_clock::duration::max(), degraded);
+}
+
+bool run(const Configuration &Config, std::chrono::steady_clock::duration budget, bool &degraded)
+{
+    return Play(Config, [&](GameMgr &mgr)
+        {
+            mgr.SetDeadline(Deadline{ budget });
+            mgr.Automatic();
+            degraded = mgr.GetDegraded();
+            return mgr.GetSucceed();
+        });
+}
+
+std::vector<bool> run(const std::vector<Configuration> &Configs)
+{
+    bool degraded;
+    return run(Configs, std::chrono::steady_clock::duration::max(), degraded);
+}
+
+std::vector<bool> run(const std::vector<Configuration> &Configs, std::chrono::steady_clock::duration budget, bool &degraded)
+{
+    std::vector<bool> res;
+    BlockSet mines;
+    degraded = false;
+    for (auto &cfg : Configs)
+    {
+        res.push_back(Play(cfg, [&](GameMgr &mgr)
+            {
+                if (!res.empty())
+                    mgr.PresetMines(mines);
+                mgr.SetDeadline(Deadline{ budget });
+                mgr.Automatic();
+                if (res.empty())
+                    mines = mgr.GetMines();
+                degraded |= mgr.GetDegraded();
+                return mgr.GetSucceed();
+            }));
+    }
+    return res;
+}
+
+bool comparable(const Configuration &lhs, const Configuration &rhs)
+{
+    return lhs.Width == rhs.Width && lhs.Height == rhs.Height &&
+        lhs.TotalMines == rhs.TotalMines && lhs.IsSNR == rhs.IsSNR &&
+        lhs.InitialPositionSpecified && rhs.InitialPositionSpecified &&
+        lhs.Index == rhs.Index;
 }
 
 void cache(const Configuration &Config)
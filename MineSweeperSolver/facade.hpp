@@ -1,5 +1,8 @@
 #pragma once
 
+#include <chrono>
+#include <vector>
+
 #include "Strategies.h"
 
 struct Configuration : Strategy // NOLINT(cppcoreguidelines-pro-type-member-init)
@@ -20,8 +23,32 @@ Configuration parse(const char *hsh);
  * Note: SeedEngine() and cache() must be called before.
  *
  * Note: This function is thread-safe.
+ *
+ * Note: CurrentArena, if any, is reset before the game.
+ * Note: Each thread keeps its last GameMgr to play the next game of the same size, see GameMgr::Reset.
  */
 bool run(const Configuration &Config);
+/* Same as above, but finish the game in a degraded way once <budget> is used up, and report so in <degraded>.
+ * See GameMgr::SetDeadline.
+ */
+bool run(const Configuration &Config, std::chrono::steady_clock::duration budget, bool &degraded);
+
+/* Full-auto runs of one random board under each of <Configs>, return if each succeeded.
+ * The board is settled by the first run and preset for the others (common random numbers).
+ *
+ * Note: SeedEngine() and cache() must be called before.
+ *
+ * Note: <Configs> must be comparable(); see below.
+ *
+ * Note: CurrentArena, if any, is reset before each run.
+ */
+std::vector<bool> run(const std::vector<Configuration> &Configs);
+/* Same as above, with <budget> for each run; <degraded> is set if any run was degraded. */
+std::vector<bool> run(const std::vector<Configuration> &Configs, std::chrono::steady_clock::duration budget, bool &degraded);
+
+/* Check if the same boards can be played under both configurations:
+ * same size, mines, SNR, and the same initial position. */
+bool comparable(const Configuration &lhs, const Configuration &rhs);
 
 /* Pre-compute binomials, which are used in Solvers.
  *
@@ -1,14 +1,27 @@
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
 #include <csignal>
+#include <cstring>
 #include <ctime>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <map>
 #include <nlohmann/json.hpp>
-#include <set>
+#include <poll.h>
+#include <random>
+#include <sys/mman.h>
+#include <sys/prctl.h>
 #include <sys/sysinfo.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include "random.h"
+#include "Arena.h"
 #include "facade.hpp"
+#include "Profile.h"
+#include "sequential.hpp"
 
 NLOHMANN_JSON_SERIALIZE_ENUM(LogicMethod, {
     { LogicMethod::Passive, "PL" },
@@ -19,6 +32,20 @@ NLOHMANN_JSON_SERIALIZE_ENUM(LogicMethod, {
     { LogicMethod::Full, "FL" },
 })
 
+NLOHMANN_JSON_SERIALIZE_ENUM(Phase, {
+    { Phase::Generate, "generate" },
+    { Phase::Reduce, "reduce" },
+    { Phase::Overlap, "overlap" },
+    { Phase::Gauss, "gauss" },
+    { Phase::Enumerate, "enumerate" },
+    { Phase::Sample, "sample" },
+    { Phase::Process, "process" },
+    { Phase::Heuristic, "heuristic" },
+    { Phase::Lookahead, "lookahead" },
+    { Phase::DrainerGenerate, "drainer-generate" },
+    { Phase::Drain, "drain" },
+})
+
 std::string to_string(const std::vector<HeuristicMethod> &dt) {
     if (dt.empty())
         return "NH";
@@ -52,10 +79,107 @@ std::string to_string(const std::vector<HeuristicMethod> &dt) {
             case HeuristicMethod::Relevant2:
                 str.push_back('2');
                 break;
+            case HeuristicMethod::MaxLookahead:
+                str.push_back('L');
+                break;
         }
     return str;
 }
 
+// one result line: a job file line, or the command line itself
+struct job {
+    std::string string;
+    std::vector<std::string> others;
+    // the first one is the baseline of the comparison
+    std::vector<Configuration> cfgs;
+    long total_num;
+    double alpha;
+    double half_width; // disabled if 0
+    double baseline; // disabled if < 0
+
+    long received = 0;
+    long succeeded = 0;
+    long errored = 0;
+    long timeout = 0;
+    long strange = 0;
+    long degraded = 0; // also counted in received, see GameMgr::SetDeadline
+    // for each cfgs[i]: succeeded, and succeeded/failed where cfgs[0] failed/succeeded
+    std::vector<long> paired_succeeded, paired_wins, paired_losses;
+    // see confidence_sequence; only maintained if sequential
+    std::pair<double, double> ci{ 0.0, 1.0 };
+    const char *stop_reason = "number";
+    bool done = false;
+    timespec end_of_computation{};
+
+    [[nodiscard]] bool sequential() const {
+        return half_width > 0 || baseline >= 0;
+    }
+
+    bool should_stop() {
+        ci = confidence_sequence(succeeded, received, alpha);
+        if (half_width > 0 && ci.second - ci.first <= 2 * half_width)
+            stop_reason = "half-width";
+        else if (baseline >= 0 && ci.first > baseline)
+            stop_reason = "above-baseline";
+        else if (baseline >= 0 && ci.second < baseline)
+            stop_reason = "below-baseline";
+        else
+            return false;
+        return true;
+    }
+};
+
+// scheduling state of a job, shared by main, monitor and workers
+struct dispatch_slot {
+    std::atomic<long> dispatched; // games handed to workers, minus those lost (E/T/U)
+    std::atomic<bool> closed; // set by main once the job has its result
+};
+
+static std::vector<job> g_jobs;
+static dispatch_slot *g_dispatch;
+static std::atomic<int> *g_current; // job played by each worker, -1 if idle
+static bool g_fair = false;
+static bool g_profile = false;
+static double g_budget = 300; // s, per game
+static const char *g_corpus = nullptr; // directory of slow positions, see record
+static double g_threshold = 1; // s, per solve
+
+/* Results counted by each worker, so that nothing is sent per game.
+ * tally(slot, id)[TALLY_OUTCOMES + mask] counts games where cfgs[i] succeeded iff bit i of mask is set;
+ * as every game increments exactly one counter, any sample of them is consistent.
+ * Counters of a worker only change by the worker itself, or by the monitor once it died.
+ */
+#define TALLY_ERRORED 0
+#define TALLY_TIMEOUT 1
+#define TALLY_STRANGE 2
+#define TALLY_DEGRADED 3
+#define TALLY_OUTCOMES 4
+static std::atomic<long> *g_tally;
+static std::vector<size_t> g_tally_offsets; // per job, and the stride of a worker at back()
+
+std::atomic<long> *tally(size_t slot, size_t id) {
+    return g_tally + g_tally_offsets.back() * slot + g_tally_offsets[id];
+}
+
+/* With -p, the outcomes are followed by the profile of finished games:
+ * total latency (us), solves and allocations, their histograms per game,
+ * and time (ns), calls and allocations of each phase, the last ones followed by those outside of any phase.
+ */
+#define PROFILE_LATENCY_SUM 0
+#define PROFILE_SOLVES_SUM 1
+#define PROFILE_ALLOCS_SUM 2
+#define PROFILE_LATENCY 3
+#define PROFILE_SOLVES (PROFILE_LATENCY + HISTOGRAM_BUCKETS)
+#define PROFILE_ALLOCS (PROFILE_SOLVES + HISTOGRAM_BUCKETS)
+#define PROFILE_NANOS (PROFILE_ALLOCS + HISTOGRAM_BUCKETS)
+#define PROFILE_CALLS (PROFILE_NANOS + static_cast<size_t>(Phase::Count))
+#define PROFILE_PHASE_ALLOCS (PROFILE_CALLS + static_cast<size_t>(Phase::Count))
+#define PROFILE_SIZE (PROFILE_PHASE_ALLOCS + static_cast<size_t>(Phase::Count) + 1)
+
+std::atomic<long> *profile_tally(size_t slot, size_t id) {
+    return tally(slot, id) + TALLY_OUTCOMES + (1z << g_jobs[id].cfgs.size());
+}
+
 static pid_t g_monitor;
 static std::sig_atomic_t g_exiting = 0;
 static std::sig_atomic_t g_alarm = 0;
@@ -82,31 +206,178 @@ void sig_empty(int signal) {
     (void) signal;
 }
 
-[[noreturn]] void worker_entry(int fd[2], const Configuration &cfg) {
+#define PAIRED_MAX 7
+
+// sum up the tallies of all workers
+void collect(job &jb, size_t id, size_t nprocs) {
+    jb.received = jb.succeeded = jb.errored = jb.timeout = jb.strange = jb.degraded = 0;
+    std::ranges::fill(jb.paired_succeeded, 0);
+    std::ranges::fill(jb.paired_wins, 0);
+    std::ranges::fill(jb.paired_losses, 0);
+    for (auto slot = 0z; slot < nprocs; slot++) {
+        auto t = tally(slot, id);
+        jb.errored += t[TALLY_ERRORED].load(std::memory_order_relaxed);
+        jb.timeout += t[TALLY_TIMEOUT].load(std::memory_order_relaxed);
+        jb.strange += t[TALLY_STRANGE].load(std::memory_order_relaxed);
+        jb.degraded += t[TALLY_DEGRADED].load(std::memory_order_relaxed);
+        for (auto mask = 0; mask < 1 << jb.cfgs.size(); mask++) {
+            auto n = t[TALLY_OUTCOMES + mask].load(std::memory_order_relaxed);
+            auto base = mask & 1;
+            jb.received += n;
+            jb.succeeded += base * n;
+            for (auto k = 1z; k < jb.cfgs.size(); k++) {
+                auto res = mask >> k & 1;
+                jb.paired_succeeded[k] += res * n;
+                jb.paired_wins[k] += (res && !base) * n;
+                jb.paired_losses[k] += (!res && base) * n;
+            }
+        }
+    }
+}
+
+/* Pick the next job to play a game of, or -1 if nothing is left.
+ * srf: the one with the fewest games left to dispatch, so short jobs report early
+ * fair: the one with the smallest dispatched fraction, so all jobs progress together
+ */
+int dispatch() {
+    while (true) {
+        auto best = -1;
+        auto best_key = 0.0;
+        for (auto i = 0; i < g_jobs.size(); i++) {
+            if (g_dispatch[i].closed)
+                continue;
+            auto dispatched = g_dispatch[i].dispatched.load();
+            auto total_num = g_jobs[i].total_num;
+            if (dispatched >= total_num)
+                continue;
+            auto key = g_fair
+                       ? static_cast<double>(dispatched) / static_cast<double>(total_num)
+                       : static_cast<double>(total_num - dispatched);
+            if (best < 0 || key < best_key)
+                best = i, best_key = key;
+        }
+        if (best < 0)
+            return -1;
+        if (g_dispatch[best].dispatched++ < g_jobs[best].total_num)
+            return best;
+        g_dispatch[best].dispatched--; // another worker took the last one
+    }
+}
+
+// bit i is set if cfgs[i] succeeded, or -1 on error
+int play(const std::vector<Configuration> &cfgs, bool &degraded) {
+    auto budget = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>{ g_budget });
+    try {
+        if (cfgs.size() == 1)
+            return run(cfgs.front(), budget, degraded) ? 1 : 0;
+        auto res = run(cfgs, budget, degraded);
+        auto mask = 0;
+        for (auto i = 0z; i < res.size(); i++)
+            if (res[i])
+                mask |= 1 << i;
+        return mask;
+    } catch (std::exception &e) {
+        return -1;
+    }
+}
+
+/* One file per position, named <seed>-<n>.mws:
+ * a text line "<config> <seed> <max depth> <shortcut> <ns>", followed by GameMgr::Save.
+ * The game can be played again by SeedEngine(<seed>) unless <config> is compared with others.
+ */
+void record(const job &jb, uint64_t seed, int &n, const SolveRecord &rec) {
+    auto i = 0z;
+    while (i < jb.cfgs.size() && static_cast<const Strategy &>(jb.cfgs[i]) != rec.BasicStrategy)
+        i++;
+    auto &string = i ? jb.others[i - 1] : jb.string;
+    char name[32];
+    snprintf(name, sizeof(name), "/%016" PRIx64 "-%d.mws", seed, n++);
+    std::ofstream fout{ g_corpus + std::string{ name }, std::ios::binary };
+    fout << string << ' ' << seed << ' ' << static_cast<int>(rec.MaxDepth) << ' ' << rec.Shortcut << ' '
+         << std::chrono::duration_cast<std::chrono::nanoseconds>(rec.Took).count() << '\n'
+         << rec.Snapshot;
+    if (!fout)
+        perror(name + 1);
+}
+
+[[noreturn]] void worker_entry(int fd[2], size_t slot) {
+    close(fd[1]);
     std::signal(SIGTERM, SIG_DFL);
+    prctl(PR_SET_PDEATHSIG, SIGKILL); // in case monitor is gone
 
     SeedEngine();
 
-    alarm(600);
+    PhaseProfile profile;
+    if (g_profile)
+        CurrentProfile = &profile;
+
+    // solver scratch of each game, see run()
+    GameArena arena;
+    CurrentArena = &arena;
+
+    // every game is seeded on its own, so that the slow ones can be reproduced
+    std::random_device rd;
+    uint64_t seed = 0;
+    auto id = -1, n = 0;
+    SolveRecorder recorder{
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>{ g_threshold }),
+            [&](const SolveRecord &rec) { record(g_jobs[id], seed, n, rec); } };
+    if (g_corpus)
+        CurrentRecorder = &recorder;
+
     while (true) {
-        char c;
-        try {
-            auto res = run(cfg);
-            c = res ? 'S' : 'F';
-        } catch (std::exception &e) {
-            c = 'E';
+        id = dispatch();
+        g_current[slot] = id;
+        if (id < 0) {
+            // wait for games lost by other workers, or to be killed
+            alarm(0);
+            sleep(1);
+            continue;
         }
-        alarm(600);
-        if (write(fd[1], &c, 1) != 1) {
-            if (errno == EPIPE)
-                exit(0);
-            perror("worker/write(3)");
-            exit(3);
+        // last resort if a game fails to degrade in time
+        alarm(static_cast<unsigned>(std::ceil(2 * g_budget * static_cast<double>(g_jobs[id].cfgs.size()))));
+        profile.Clear();
+        if (g_corpus) {
+            seed = static_cast<uint64_t>(rd()) << 32 | rd();
+            n = 0;
+            SeedEngine(seed);
+        }
+        auto begin = std::chrono::steady_clock::now();
+        bool degraded;
+        auto res = play(g_jobs[id].cfgs, degraded);
+        if (res >= 0) {
+            if (degraded)
+                tally(slot, id)[TALLY_DEGRADED].fetch_add(1, std::memory_order_relaxed);
+            tally(slot, id)[TALLY_OUTCOMES + res].fetch_add(1, std::memory_order_relaxed);
+            if (g_profile) {
+                auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - begin).count();
+                auto t = profile_tally(slot, id);
+                t[PROFILE_LATENCY_SUM].fetch_add(us, std::memory_order_relaxed);
+                t[PROFILE_SOLVES_SUM].fetch_add(profile.Solves, std::memory_order_relaxed);
+                auto allocs = 0ul;
+                for (auto a : profile.Allocations)
+                    allocs += a;
+                t[PROFILE_ALLOCS_SUM].fetch_add(allocs, std::memory_order_relaxed);
+                t[PROFILE_LATENCY + HistogramBucket(us)].fetch_add(1, std::memory_order_relaxed);
+                t[PROFILE_SOLVES + HistogramBucket(profile.Solves)].fetch_add(1, std::memory_order_relaxed);
+                t[PROFILE_ALLOCS + HistogramBucket(allocs)].fetch_add(1, std::memory_order_relaxed);
+                for (auto ph = 0z; ph < static_cast<size_t>(Phase::Count); ph++) {
+                    t[PROFILE_NANOS + ph].fetch_add(profile.Nanos[ph], std::memory_order_relaxed);
+                    t[PROFILE_CALLS + ph].fetch_add(profile.Calls[ph], std::memory_order_relaxed);
+                }
+                for (auto ph = 0z; ph <= static_cast<size_t>(Phase::Count); ph++)
+                    t[PROFILE_PHASE_ALLOCS + ph].fetch_add(profile.Allocations[ph], std::memory_order_relaxed);
+            }
+        } else {
+            tally(slot, id)[TALLY_ERRORED].fetch_add(1, std::memory_order_relaxed);
+            g_dispatch[id].dispatched--; // the game is lost, have it played again
         }
     }
 }
 
-[[noreturn]] void monitor_entry(int fd[2], const Configuration &cfg, size_t n) {
+[[noreturn]] void monitor_entry(int fd[2], size_t n) {
     close(fd[0]);
 
     struct sigaction sa = {};
@@ -116,14 +387,15 @@ void sig_empty(int signal) {
     sigaction(SIGQUIT, &sa, nullptr);
     sigaction(SIGPIPE, &sa, nullptr);
     sigaction(SIGTERM, &sa, nullptr);
+    prctl(PR_SET_PDEATHSIG, SIGTERM); // in case main is gone
 
-    // spawn workers
-    std::set<pid_t> workers;
-    for (auto i = 0; i < n; i++)
+    // spawn workers; pid -> slot
+    std::map<pid_t, size_t> workers;
+    for (auto i = 0z; i < n; i++)
         if (auto p = fork(); !p)
-            worker_entry(fd, cfg);
+            worker_entry(fd, i);
         else
-            workers.insert(p);
+            workers.emplace(p, i);
 
     // monitor worker exits
     while (true) {
@@ -135,10 +407,10 @@ void sig_empty(int signal) {
         }
 
         // Verify if main process is still there
-        char ch;
-        if (pid <= 0) {
-            ch = 't';
-        } else {
+        char ch = 't';
+        auto slot = 0z;
+        if (pid > 0) {
+            slot = workers.at(pid);
             if (WIFSIGNALED(ws)) {
                 switch (WTERMSIG(ws)) {
                     case SIGALRM: // timeout
@@ -162,15 +434,31 @@ void sig_empty(int signal) {
                 if (WEXITSTATUS(ws) != 0) {
                     std::cerr << "\nWarning: Worker " << pid << " exited with " << WEXITSTATUS(ws) << "\n";
                     ch = 'U';
-                } else {
-                    ch = 't';
                 }
             } else {
                 std::cerr << "\nWarning: Worker " << pid << " wtf-ed\n";
                 ch = 'U';
             }
             workers.erase(pid);
+
+            // the game in progress is lost, have it played again
+            if (auto id = g_current[slot].load(); id >= 0 && ch != 't') {
+                auto t = tally(slot, id);
+                switch (ch) {
+                    case 'T':
+                        t[TALLY_TIMEOUT]++;
+                        break;
+                    case 'E':
+                        t[TALLY_ERRORED]++;
+                        break;
+                    default:
+                        t[TALLY_STRANGE]++;
+                        break;
+                }
+                g_dispatch[id].dispatched--;
+            }
         }
+        // only for liveness: main samples the tallies by itself
         if (write(fd[1], &ch, 1) != 1) {
             if (errno == EPIPE)
                 break;
@@ -180,15 +468,16 @@ void sig_empty(int signal) {
 
         // replenish workers
         if (pid > 0) {
+            g_current[slot] = -1;
             if (auto p = fork(); !p)
-                worker_entry(fd, cfg);
+                worker_entry(fd, slot);
             else
-                workers.insert(p);
+                workers.emplace(p, slot);
         }
     }
 
     // Exiting: send SIGTERM and then SIGKILL
-    for (auto p: workers)
+    for (auto [p, slot] : workers)
         if (kill(p, SIGKILL))
             if (errno != ESRCH)
                 perror("monitor/kill(3)");
@@ -214,25 +503,284 @@ void sig_empty(int signal) {
     exit(0);
 }
 
+// summary of the profiles of all workers; games finished after the job was closed are included
+nlohmann::json profile_json(size_t id, size_t nprocs) {
+    std::vector<long> sum(PROFILE_SIZE);
+    for (auto slot = 0z; slot < nprocs; slot++) {
+        auto t = profile_tally(slot, id);
+        for (auto i = 0z; i < PROFILE_SIZE; i++)
+            sum[i] += t[i].load(std::memory_order_relaxed);
+    }
+
+    auto games = 0l;
+    for (auto i = 0z; i < HISTOGRAM_BUCKETS; i++)
+        games += sum[PROFILE_LATENCY + i];
+    auto histogram = [&](size_t offset, long total) {
+        nlohmann::json j;
+        j["mean"] = games ? static_cast<double>(total) / static_cast<double>(games) : 0.0;
+        // lower bounds of the buckets, with 3 significant bits
+        static const std::pair<double, const char *> percentiles[]{
+            { 0.5, "p50" }, { 0.9, "p90" }, { 0.99, "p99" }, { 0.999, "p999" }, { 1.0, "max" } };
+        auto p = std::begin(percentiles);
+        auto seen = 0l;
+        for (auto i = 0z; i < HISTOGRAM_BUCKETS; i++) {
+            if (!sum[offset + i])
+                continue;
+            seen += sum[offset + i];
+            j["histogram"].push_back({ HistogramLowerBound(i), sum[offset + i] });
+            for (; p != std::end(percentiles) && static_cast<double>(seen) >= p->first * static_cast<double>(games); ++p)
+                j[p->second] = HistogramLowerBound(i);
+        }
+        return j;
+    };
+
+    nlohmann::json j;
+    j["games"] = games;
+    j["latency"] = histogram(PROFILE_LATENCY, sum[PROFILE_LATENCY_SUM]);
+    j["latency"]["unit"] = "us";
+    j["solves"] = histogram(PROFILE_SOLVES, sum[PROFILE_SOLVES_SUM]);
+    j["allocations"] = histogram(PROFILE_ALLOCS, sum[PROFILE_ALLOCS_SUM]);
+    auto total = static_cast<double>(sum[PROFILE_LATENCY_SUM]) * 1e-6;
+    auto other = total;
+    for (auto ph = 0z; ph < static_cast<size_t>(Phase::Count); ph++) {
+        auto &p = j["phases"][nlohmann::json(static_cast<Phase>(ph)).get<std::string>()];
+        p["duration"] = static_cast<double>(sum[PROFILE_NANOS + ph]) * 1e-9;
+        p["calls"] = sum[PROFILE_CALLS + ph];
+        p["allocations"] = sum[PROFILE_PHASE_ALLOCS + ph];
+        other -= p["duration"].get<double>();
+    }
+    // board setup, opening blocks, and everything else outside of a phase
+    j["phases"]["other"]["duration"] = MAX(other, 0.0);
+    j["phases"]["other"]["allocations"] = sum[PROFILE_PHASE_ALLOCS + static_cast<size_t>(Phase::Count)];
+    for (auto &[name, p] : j["phases"].items())
+        p["share"] = total > 0 ? p["duration"].get<double>() / total : 0.0;
+    return j;
+}
+
+void print_result(const job &jb, const timespec &start_of_computation, int nprocs) {
+    auto &cfg = jb.cfgs.front();
+    nlohmann::json j;
+    j["string"] = jb.string;
+    j["game"]["width"] = cfg.Width;
+    j["game"]["height"] = cfg.Height;
+    j["game"]["mines"] = cfg.TotalMines;
+    j["game"]["snr"] = cfg.IsSNR;
+    j["strategy"]["logic"] = cfg.Logic;
+    if (!cfg.InitialPositionSpecified)
+        j["strategy"]["initial"] = nullptr;
+    else
+        j["strategy"]["initial"] = { { "x", cfg.Index % cfg.Width + 1 },
+                                     { "y", cfg.Index / cfg.Width + 1 } };
+    if (!cfg.HeuristicEnabled)
+        j["strategy"]["heuristic"] = "Pure";
+    else {
+        j["strategy"]["heuristic"] = to_string(cfg.DecisionTree);
+    }
+    if (!cfg.ExhaustEnabled)
+        j["strategy"]["exhaust"] = 0;
+    else
+        j["strategy"]["exhaust"] = cfg.ExhaustCriterion;
+    if (!cfg.PruningEnabled)
+        j["strategy"]["pruning"] = 0;
+    else
+        j["strategy"]["pruning"] = cfg.PruningCriterion;
+    j["result"]["pass"] = jb.succeeded;
+    j["result"]["fail"] = jb.received - jb.succeeded;
+    j["result"]["error"] = jb.errored;
+    j["result"]["timeout"] = jb.timeout;
+    j["result"]["strange"] = jb.strange;
+    j["result"]["degraded"] = jb.degraded;
+    // wins among discordant pairs are compared with 1/2, as in the sign test
+    for (auto i = 1z; i < jb.cfgs.size(); i++) {
+        auto &p = j["paired"].emplace_back();
+        p["string"] = jb.others[i - 1];
+        p["pass"] = jb.paired_succeeded[i];
+        p["fail"] = jb.received - jb.paired_succeeded[i];
+        p["wins"] = jb.paired_wins[i];
+        p["losses"] = jb.paired_losses[i];
+        auto w = confidence_sequence(jb.paired_wins[i], jb.paired_wins[i] + jb.paired_losses[i], jb.alpha);
+        p["win-ratio"] = { { "alpha", jb.alpha }, { "lower", w.first }, { "upper", w.second } };
+    }
+    if (jb.sequential()) {
+        auto ci = confidence_sequence(jb.succeeded, jb.received, jb.alpha);
+        j["sequential"]["alpha"] = jb.alpha;
+        j["sequential"]["lower"] = ci.first;
+        j["sequential"]["upper"] = ci.second;
+        j["sequential"]["stop"] = jb.stop_reason;
+        if (jb.half_width > 0)
+            j["sequential"]["half-width"] = jb.half_width;
+        if (jb.baseline >= 0)
+            j["sequential"]["baseline"] = jb.baseline;
+    }
+    // jobs of a job file share the pool from the very beginning
+    auto &end_of_computation = jb.end_of_computation;
+    j["exec"]["duration"] = static_cast<double>(end_of_computation.tv_sec - start_of_computation.tv_sec)
+                            + static_cast<double>(end_of_computation.tv_nsec - start_of_computation.tv_nsec) * 1e-9;
+    j["exec"]["cpu"] = nprocs;
+    j["exec"]["speed"] = static_cast<double>(jb.received) / j["exec"]["duration"].get<double>() / nprocs;
+    if (g_profile)
+        j["exec"]["profile"] = profile_json(&jb - g_jobs.data(), nprocs);
+    std::cout << j << std::endl;
+}
+
 int main(int argc, char *argv[]) {
-    if (argc < 2 || argc > 4) {
-        std::cout << "Usage: " << argv[0]
-                  << R"( [PSDF]L(@\[<I>,<J>\])?-(NH|Pure|[PZSEQFU2]+)(-D<D>)?-<W>-<H>-T<M>-(SFAR|SNR) [<number> [<nprocs>]])"
+    const auto prog = argv[0];
+    auto usage = [prog] {
+        std::cout << "Usage: " << prog
+                  << R"( [-w <half-width>] [-b <baseline>] [-a <alpha>] [-t <budget>] [-p] [-r <corpus> [-R <threshold>]] [-c <config>]...)"
+                  << R"( [PSDF]L(@\[<I>,<J>\])?-(NH|Pure|[PZSEQFU2L]+)(-D<D>)?-<W>-<H>-T<M>-(SFAR|SNR) [<number> [<nprocs>]])"
+                  << "\n       " << prog
+                  << R"( [-w <half-width>] [-b <baseline>] [-a <alpha>] [-t <budget>] [-p] [-r <corpus> [-R <threshold>]] [-o srf|fair] -j <job file> [<nprocs>])"
+                  << "\n  -w: stop early once the confidence interval is narrower than +-<half-width>"
+                  << "\n  -b: stop early once the success rate is known to be above/below <baseline>"
+                  << "\n  -a: error rate of the (anytime-valid) confidence interval, default 0.05"
+                  << "\n  -t: seconds for each game before the solver degrades (counted as D), default 300;"
+                  << "\n      games still running after twice as long are killed (counted as T)"
+                  << "\n  -p: add latency and solves per game, and time of each phase, as exec.profile"
+                  << "\n  -r: save positions that take long to solve into the directory <corpus>, see MineSweeperReplay"
+                  << "\n  -R: seconds for a single solve to be saved by -r, default 1"
+                  << "\n  -c: also play every board under <config>, and compare with the first one"
+                  << "\n  -j: run every job of <job file> on one pool of workers, one result line each;"
+                  << "\n      each line is {\"string\": <config>, \"number\": <number>},"
+                  << "\n      optionally with \"compare\": [<config>...], \"half-width\", \"baseline\", \"alpha\""
+                  << "\n  -o: job order: shortest remaining first (default), or fair share"
                   << std::endl;
         return 2;
+    };
+
+    auto alpha = 0.05;
+    auto half_width = 0.0; // disabled
+    auto baseline = -1.0; // disabled
+    std::vector<std::string> others;
+    const char *job_file = nullptr;
+    for (int opt; (opt = getopt(argc, argv, "w:b:a:t:pr:R:c:j:o:")) != -1;)
+        switch (opt) {
+            case 'c':
+                others.emplace_back(optarg);
+                break;
+            case 'w':
+                half_width = std::atof(optarg);
+                break;
+            case 'b':
+                baseline = std::atof(optarg);
+                break;
+            case 'a':
+                alpha = std::atof(optarg);
+                break;
+            case 't':
+                g_budget = std::atof(optarg);
+                if (!(g_budget > 0))
+                    return usage();
+                break;
+            case 'p':
+                g_profile = true;
+                break;
+            case 'r':
+                g_corpus = optarg;
+                break;
+            case 'R':
+                g_threshold = std::atof(optarg);
+                if (!(g_threshold >= 0))
+                    return usage();
+                break;
+            case 'j':
+                job_file = optarg;
+                break;
+            case 'o':
+                if (!strcmp(optarg, "fair"))
+                    g_fair = true;
+                else if (strcmp(optarg, "srf"))
+                    return usage();
+                break;
+            default:
+                return usage();
+        }
+    argc -= optind - 1, argv += optind - 1;
+    if (job_file ? argc > 2 || !others.empty() : argc < 2 || argc > 4)
+        return usage();
+    if (g_corpus) {
+        std::error_code ec;
+        std::filesystem::create_directories(g_corpus, ec);
+        if (ec) {
+            std::cerr << g_corpus << ": " << ec.message() << "\n";
+            return 1;
+        }
     }
 
-    auto cfg = parse(argv[1]);
-    cache(cfg);
+    auto add_job = [&](std::string string, std::vector<std::string> cmps, long number) {
+        auto &jb = g_jobs.emplace_back();
+        jb.cfgs.push_back(parse(string.c_str()));
+        cache(jb.cfgs.front());
+        for (auto &o : cmps) {
+            jb.cfgs.push_back(parse(o.c_str()));
+            if (!comparable(jb.cfgs.front(), jb.cfgs.back())) {
+                std::cerr << o << " cannot share boards with " << string << "\n";
+                return false;
+            }
+        }
+        if (jb.cfgs.size() > PAIRED_MAX) {
+            std::cerr << "At most " << PAIRED_MAX << " configs can be compared\n";
+            return false;
+        }
+        jb.string = std::move(string);
+        jb.others = std::move(cmps);
+        jb.total_num = number;
+        jb.alpha = alpha;
+        jb.half_width = half_width;
+        jb.baseline = baseline;
+        jb.paired_succeeded.resize(jb.cfgs.size());
+        jb.paired_wins.resize(jb.cfgs.size());
+        jb.paired_losses.resize(jb.cfgs.size());
+        return true;
+    };
+
+    if (job_file) {
+        std::ifstream fin{ job_file };
+        if (!fin) {
+            perror(job_file);
+            return 1;
+        }
+        auto line_no = 0;
+        for (std::string line; std::getline(fin, line);) {
+            line_no++;
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+                continue;
+            try {
+                auto j = nlohmann::json::parse(line);
+                auto number = j.at("number").get<long>();
+                if (number <= 0)
+                    throw std::runtime_error("number must be positive");
+                if (!add_job(j.at("string").get<std::string>(),
+                             j.value("compare", std::vector<std::string>{}), number))
+                    return 2;
+                auto &jb = g_jobs.back();
+                jb.alpha = j.value("alpha", jb.alpha);
+                jb.half_width = j.value("half-width", jb.half_width);
+                jb.baseline = j.value("baseline", jb.baseline);
+            } catch (std::exception &e) {
+                std::cerr << job_file << ":" << line_no << ": " << e.what() << "\n";
+                return 2;
+            }
+        }
+        if (g_jobs.empty()) {
+            std::cerr << job_file << ": no jobs\n";
+            return 2;
+        }
+    } else if (!add_job(argv[1], others, argc < 3 ? 0 : std::atol(argv[2]))) {
+        return 2;
+    }
 
-    if (argc == 2) {
+    if (!job_file && argc == 2) {
+        auto &cfgs = g_jobs.front().cfgs;
         SeedEngine();
 
 #pragma clang diagnostic push
 #pragma ide diagnostic ignored "EndlessLoop"
         while (true) {
-            auto res = run(cfg);
-            std::cout << (res ? 'S' : 'F');
+            for (auto res : run(cfgs))
+                std::cout << (res ? 'S' : 'F');
+            if (cfgs.size() > 1)
+                std::cout << ' ';
             std::flush(std::cout);
         }
 #pragma clang diagnostic pop
@@ -242,16 +790,26 @@ int main(int argc, char *argv[]) {
 
     const auto report_interval = is_tty ? 5 : 60; // s
 
-    auto total_num = std::atol(argv[2]);
+    const auto title = job_file ? job_file : argv[1];
+    auto total_num = 0l;
+    for (auto &jb : g_jobs)
+        total_num += jb.total_num;
+    auto pending = g_jobs.size();
     auto old_received = 0l;
-    auto received = 0l;
-    auto succeeded = 0l;
-    auto errored = 0l;
-    auto timeout = 0l;
-    auto strange = 0l;
     auto report = [&] {
-        std::cerr << argv[1] << " "
-                  << received << "/" << total_num
+        auto received = 0l, succeeded = 0l, errored = 0l, timeout = 0l, strange = 0l, degraded = 0l;
+        for (auto &jb : g_jobs) {
+            received += jb.received;
+            succeeded += jb.succeeded;
+            errored += jb.errored;
+            timeout += jb.timeout;
+            strange += jb.strange;
+            degraded += jb.degraded;
+        }
+        std::cerr << title << " ";
+        if (job_file)
+            std::cerr << g_jobs.size() - pending << "/" << g_jobs.size() << " jobs, ";
+        std::cerr << received << "/" << total_num
                   << " (" << 100.0 * static_cast<double>(received) / static_cast<double>(total_num)
                   << "%): "
                   << succeeded << "/" << received
@@ -260,31 +818,66 @@ int main(int argc, char *argv[]) {
                   << errored << " E, "
                   << timeout << " T, "
                   << strange << " U, "
-                  << static_cast<double>(received - old_received) / report_interval << " OP/s"
-                  << (is_tty ? "\r" : "\n");
+                  << degraded << " D, "
+                  << static_cast<double>(received - old_received) / report_interval << " OP/s";
+        if (!job_file) {
+            auto &jb = g_jobs.front();
+            if (jb.sequential()) {
+                jb.ci = confidence_sequence(jb.succeeded, jb.received, jb.alpha);
+                std::cerr << ", CI [" << 100.0 * jb.ci.first << "%, " << 100.0 * jb.ci.second << "%]";
+            }
+            for (auto i = 1z; i < jb.cfgs.size(); i++)
+                std::cerr << ", #" << i << " +" << jb.paired_wins[i] << "/-" << jb.paired_losses[i];
+        }
+        std::cerr << (is_tty ? "\r" : "\n");
         old_received = received;
     };
 
     // Process Hierarchy:
     //
-    // main: read from fd[0]
-    //   monitor: ensure enough workers are running
-    //      worker: compute and write to fd[1]
-    //      worker: compute and write to fd[1]
+    // main: sample g_tally, close finished jobs in g_dispatch
+    //   monitor: ensure enough workers are running, write to fd[1] on exits
+    //      worker: pick a job from g_dispatch, compute and count in g_tally
+    //      worker: pick a job from g_dispatch, compute and count in g_tally
     //      ...
 
+    auto nprocs = job_file
+                  ? argc < 2 ? get_nprocs() : std::atoi(argv[1])
+                  : argc < 4 ? get_nprocs() : std::atoi(argv[3]);
+
+    // each worker has its tallies on their own cache lines
+    constexpr auto cache_line = 64 / sizeof(std::atomic<long>);
+    g_tally_offsets.push_back(0);
+    for (auto &jb : g_jobs)
+        g_tally_offsets.push_back(g_tally_offsets.back() + TALLY_OUTCOMES + (1z << jb.cfgs.size())
+                                  + (g_profile ? PROFILE_SIZE : 0));
+    g_tally_offsets.back() = (g_tally_offsets.back() + cache_line - 1) / cache_line * cache_line;
+    auto tally_begin = g_jobs.size() * sizeof(dispatch_slot) + nprocs * sizeof(std::atomic<int>);
+    tally_begin = (tally_begin + 63) / 64 * 64;
+    auto tally_size = g_tally_offsets.back() * nprocs;
+    auto shared_size = tally_begin + tally_size * sizeof(std::atomic<long>);
+    auto shared = mmap(nullptr, shared_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        perror("main/mmap(3)");
+        return 1;
+    }
+    g_dispatch = new(shared) dispatch_slot[g_jobs.size()]{};
+    g_current = new(g_dispatch + g_jobs.size()) std::atomic<int>[nprocs]{};
+    g_tally = new(static_cast<char *>(shared) + tally_begin) std::atomic<long>[tally_size]{};
+
     int fd[2];
     if (pipe(fd)) {
         perror("main/pipe(3)");
         return 1;
     }
 
-    auto nprocs = argc < 4 ? get_nprocs() : std::atoi(argv[3]);
     if (!(g_monitor = fork()))
-        monitor_entry(fd, cfg, nprocs);
+        monitor_entry(fd, nprocs);
     close(fd[1]);
-    std::cerr << argv[1] << "  Main PID: " << getpid()<< "  Monitor PID: " << g_monitor
-            << " Num: " << total_num << "  CPUs: " << nprocs << "\n";
+    std::cerr << title << "  Main PID: " << getpid()<< "  Monitor PID: " << g_monitor;
+    if (job_file)
+        std::cerr << " Jobs: " << g_jobs.size();
+    std::cerr << " Num: " << total_num << "  CPUs: " << nprocs << "\n";
 
     struct sigaction sa = {};
     sa.sa_handler = &sig_handler;
@@ -297,52 +890,65 @@ int main(int argc, char *argv[]) {
     timespec start_of_computation;
     clock_gettime(CLOCK_MONOTONIC, &start_of_computation);
 
+    auto finish_job = [&](size_t id) {
+        auto &jb = g_jobs[id];
+        jb.done = true;
+        g_dispatch[id].closed = true;
+        clock_gettime(CLOCK_MONOTONIC, &jb.end_of_computation);
+        pending--;
+        print_result(jb, start_of_computation, nprocs);
+    };
+
     auto old_alarm = g_alarm;
     alarm(report_interval);
 
-    char buf[16384];
-    while (received < total_num) {
-        if (g_exiting)
-            goto finish;
+    auto sample = [&] {
+        for (auto id = 0z; id < g_jobs.size(); id++) {
+            auto &jb = g_jobs[id];
+            if (jb.done)
+                continue;
+            auto old_received = jb.received;
+            collect(jb, id, nprocs);
+            if (jb.received >= jb.total_num)
+                finish_job(id);
+            // checking often is fine: the interval is valid at any stopping time
+            else if (jb.sequential() && jb.received / 256 > old_received / 256 && jb.should_stop())
+                finish_job(id);
+        }
+    };
+
+    const auto sample_interval = 10; // ms
+    while (pending) {
+        if (g_exiting) {
+            sample();
+            for (auto i = 0z; i < g_jobs.size(); i++)
+                if (!g_jobs[i].done) {
+                    g_jobs[i].stop_reason = "interrupted";
+                    finish_job(i);
+                }
+            break;
+        }
         auto new_alarm = g_alarm;
         if (new_alarm > old_alarm) {
             report();
             old_alarm = new_alarm;
             alarm(report_interval);
         }
-        if (auto len = read(fd[0], buf, sizeof(buf)); len > 0) {
-            for (auto i = 0z; i < len; i++)
-                switch (buf[i]) {
-                    case 'S':
-                        succeeded++;
-                        [[fallthrough]];
-                    case 'F':
-                        if (++received >= total_num)
-                            goto finish;
-                        break;
-                    case 'T':
-                        timeout++;
-                        break;
-                    case 'E':
-                        errored++;
-                        break;
-                    case 'U':
-                        strange++;
-                        break;
-                }
-        } else if (len == 0) {
-            std::cerr << "Warning: Pipe closed too soon\n";
-            break;
-        } else if (errno != EINTR) {
-            perror("main/read(3)");
-            exit(3);
+        // a worker has exited: nothing to do but to sample at once
+        pollfd pfd{ fd[0], POLLIN, 0 };
+        if (poll(&pfd, 1, sample_interval) > 0) {
+            char buf[256];
+            if (auto len = read(fd[0], buf, sizeof(buf)); len == 0) {
+                std::cerr << "Warning: Pipe closed too soon\n";
+                break;
+            } else if (len < 0 && errno != EINTR) {
+                perror("main/read(3)");
+                exit(3);
+            }
         }
+        sample();
     }
 
-    finish:;
-    timespec end_of_computation;
-    clock_gettime(CLOCK_MONOTONIC, &end_of_computation);
-
     close(fd[0]);
     kill(g_monitor, SIGTERM);
     int ws;
@@ -353,40 +959,4 @@ int main(int argc, char *argv[]) {
             goto fin_waitpid_again;
         exit(3);
     }
-
-    nlohmann::json j;
-    j["string"] = argv[1];
-    j["game"]["width"] = cfg.Width;
-    j["game"]["height"] = cfg.Height;
-    j["game"]["mines"] = cfg.TotalMines;
-    j["game"]["snr"] = cfg.IsSNR;
-    j["strategy"]["logic"] = cfg.Logic;
-    if (!cfg.InitialPositionSpecified)
-        j["strategy"]["initial"] = nullptr;
-    else
-        j["strategy"]["initial"] = { { "x", cfg.Index % cfg.Width + 1 },
-                                     { "y", cfg.Index / cfg.Width + 1 } };
-    if (!cfg.HeuristicEnabled)
-        j["strategy"]["heuristic"] = "Pure";
-    else {
-        j["strategy"]["heuristic"] = to_string(cfg.DecisionTree);
-    }
-    if (!cfg.ExhaustEnabled)
-        j["strategy"]["exhaust"] = 0;
-    else
-        j["strategy"]["exhaust"] = cfg.ExhaustCriterion;
-    if (!cfg.PruningEnabled)
-        j["strategy"]["pruning"] = 0;
-    else
-        j["strategy"]["pruning"] = cfg.PruningCriterion;
-    j["result"]["pass"] = succeeded;
-    j["result"]["fail"] = received - succeeded;
-    j["result"]["error"] = errored;
-    j["result"]["timeout"] = timeout;
-    j["result"]["strange"] = strange;
-    j["exec"]["duration"] = static_cast<double>(end_of_computation.tv_sec - start_of_computation.tv_sec)
-                            + static_cast<double>(end_of_computation.tv_nsec - start_of_computation.tv_nsec) * 1e-9;
-    j["exec"]["cpu"] = nprocs;
-    j["exec"]["speed"] = static_cast<double>(received) / j["exec"]["duration"].get<double>() / nprocs;
-    std::cout << j << std::endl;
 }
@@ -0,0 +1,249 @@
+#include "mws.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include "BinomialHelper.h"
+#include "GameMgr.h"
+#include "facade.hpp"
+
+static_assert(MWS_REDUCE == static_cast<int>(SolvingState::Reduce));
+static_assert(MWS_OVERLAP == static_cast<int>(SolvingState::Overlap));
+static_assert(MWS_PROBABILITY == static_cast<int>(SolvingState::Probability));
+static_assert(MWS_HEURISTIC == static_cast<int>(SolvingState::Heuristic));
+static_assert(MWS_APPROXIMATE == static_cast<int>(SolvingState::Approximate));
+
+struct mws_game
+{
+    GameMgr Mgr;
+};
+
+static thread_local std::string LastError;
+
+// refused before anything is changed
+struct Invalid : std::invalid_argument
+{
+    using std::invalid_argument::invalid_argument;
+};
+
+// the caller is told the size needed, and shall try again
+struct TooSmall : std::length_error
+{
+    TooSmall() : std::length_error{ "buffer too small" } { }
+};
+
+/* Run <fun> and turn whatever it throws into an error code, see mws_last_error */
+template <typename F>
+static int Guard(F fun)
+{
+    try
+    {
+        fun();
+        return MWS_OK;
+    }
+    catch (const Invalid &e)
+    {
+        LastError = e.what();
+        return MWS_ERROR_INVALID;
+    }
+    catch (const TooSmall &e)
+    {
+        LastError = e.what();
+        return MWS_ERROR_BUFFER;
+    }
+    catch (const Infeasible &e)
+    {
+        LastError = e.what();
+        return MWS_ERROR_INFEASIBLE;
+    }
+    catch (const std::bad_alloc &e)
+    {
+        LastError = e.what();
+        return MWS_ERROR_MEMORY;
+    }
+    catch (const std::exception &e)
+    {
+        LastError = e.what();
+        return MWS_ERROR_INTERNAL;
+    }
+    catch (...)
+    {
+        LastError = "unknown error";
+        return MWS_ERROR_INTERNAL;
+    }
+}
+
+static Configuration Parse(const char *config)
+{
+    if (!config)
+        throw Invalid{ "config is null" };
+    try
+    {
+        return parse(config);
+    }
+    catch (const std::runtime_error &e)
+    {
+        throw Invalid{ e.what() };
+    }
+}
+
+static void CheckBlock(const mws_game *game, int block)
+{
+    if (!game)
+        throw Invalid{ "game is null" };
+    if (block < 0 || block >= game->Mgr.GetTotalWidth() * game->Mgr.GetTotalHeight())
+        throw Invalid{ "block out of range" };
+}
+
+unsigned mws_api_version(void)
+{
+    return MWS_API_VERSION;
+}
+
+const char *mws_last_error(void)
+{
+    return LastError.c_str();
+}
+
+int mws_game_create(const char *config, mws_game **game)
+{
+    return Guard([&]
+        {
+            if (!game)
+                throw Invalid{ "game is null" };
+            auto cfg = Parse(config);
+            CacheBinomials(cfg.Width * cfg.Height, cfg.TotalMines);
+            *game = new mws_game{ GameMgr{ cfg.Width, cfg.Height, cfg.TotalMines, cfg } };
+        });
+}
+
+int mws_game_load(const char *config, const void *data, size_t size, mws_game **game)
+{
+    return Guard([&]
+        {
+            if (!game || !data && size)
+                throw Invalid{ "game or data is null" };
+            auto cfg = Parse(config);
+            try
+            {
+                *game = new mws_game{ GameMgr{ std::string_view{ static_cast<const char *>(data), size }, cfg } };
+            }
+            catch (const std::runtime_error &e)
+            {
+                throw Invalid{ e.what() };
+            }
+        });
+}
+
+void mws_game_destroy(mws_game *game)
+{
+    delete game;
+}
+
+int mws_game_size(const mws_game *game, int *width, int *height, int *mines)
+{
+    return Guard([&]
+        {
+            if (!game)
+                throw Invalid{ "game is null" };
+            if (width)
+                *width = game->Mgr.GetTotalWidth();
+            if (height)
+                *height = game->Mgr.GetTotalHeight();
+            if (mines)
+                *mines = game->Mgr.GetTotalMines();
+        });
+}
+
+int mws_set_degree(mws_game *game, int block, int degree)
+{
+    return Guard([&]
+        {
+            CheckBlock(game, block);
+            if (degree < 0 || degree > 8)
+                throw Invalid{ "degree out of range" };
+            if (game->Mgr.GetSolver().GetBlockStatus(block) == BlockStatus::Mine)
+                throw Invalid{ "block is a mine" };
+            (void)game->Mgr.SetBlockDegree(block, degree);
+        });
+}
+
+int mws_set_mine(mws_game *game, int block)
+{
+    return Guard([&]
+        {
+            CheckBlock(game, block);
+            if (game->Mgr.GetSolver().GetBlockStatus(block) == BlockStatus::Blank)
+                throw Invalid{ "block is blank" };
+            (void)game->Mgr.SetBlockMine(block, true);
+        });
+}
+
+int mws_solve(mws_game *game, double budget_ms, unsigned *reached)
+{
+    return Guard([&]
+        {
+            if (!game)
+                throw Invalid{ "game is null" };
+            Deadline deadline;
+            if (budget_ms > 0)
+                deadline = Deadline{ std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>{ budget_ms }) };
+            auto st = game->Mgr.Solve(SolvingState::Reduce | SolvingState::Overlap | SolvingState::Probability | SolvingState::Heuristic, false, std::move(deadline));
+            // external games stop instead of throwing, see GameMgr::Solve
+            if (!game->Mgr.GetStarted())
+                throw Infeasible{};
+            if (reached)
+                *reached = static_cast<unsigned>(st);
+        });
+}
+
+int mws_probabilities(const mws_game *game, double *out, size_t capacity)
+{
+    return Guard([&]
+        {
+            if (!game || !out)
+                throw Invalid{ "game or out is null" };
+            auto n = game->Mgr.GetTotalWidth() * game->Mgr.GetTotalHeight();
+            if (capacity < n)
+                throw TooSmall{};
+            for (auto id = 0; id < n; ++id)
+                out[id] = game->Mgr.GetBlockProbability(id);
+        });
+}
+
+int mws_best_blocks(const mws_game *game, int *out, size_t capacity, size_t *count)
+{
+    return Guard([&]
+        {
+            if (!game || !count)
+                throw Invalid{ "game or count is null" };
+            auto &mgr = game->Mgr;
+            auto &lst = mgr.GetBestBlockCount() ? mgr.GetBestBlockList() : mgr.GetPreferredBlockList();
+            *count = lst.size();
+            if (lst.size() > capacity)
+                throw TooSmall{};
+            if (!out && !lst.empty())
+                throw Invalid{ "out is null" };
+            std::copy(lst.begin(), lst.end(), out);
+        });
+}
+
+int mws_game_save(const mws_game *game, void *out, size_t capacity, size_t *size)
+{
+    return Guard([&]
+        {
+            if (!game || !size)
+                throw Invalid{ "game or size is null" };
+            auto snap = game->Mgr.Deflate();
+            *size = snap.size();
+            if (snap.size() > capacity)
+                throw TooSmall{};
+            if (!out)
+                throw Invalid{ "out is null" };
+            std::memcpy(out, snap.data(), snap.size());
+        });
+}
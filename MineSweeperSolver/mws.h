@@ -0,0 +1,87 @@
+#pragma once
+
+/* C interface of libmws, for embedding the solver without C++
+ *
+ * Games are opaque handles to external games, see GameMgr(int, int, int, Strategy):
+ * the caller reports what is known of the board, and reads back probabilities and blocks to open.
+ * Blocks are numbered x * height + y.
+ *
+ * Every function but mws_api_version, mws_last_error and mws_game_destroy returns MWS_OK or an error;
+ * no C++ exception leaves the library.
+ *
+ * Note: A handle must not be used by two threads at once; distinct handles may.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped on every incompatible change; the symbols are versioned as MWS_<version> */
+#define MWS_API_VERSION 1
+
+typedef struct mws_game mws_game;
+
+enum {
+    MWS_OK = 0,
+    MWS_ERROR_INVALID = -1, /* bad argument, or a block contradicting what is known */
+    MWS_ERROR_BUFFER = -2, /* buffer too small; the size needed is reported */
+    MWS_ERROR_INFEASIBLE = -3, /* no board fits what is known */
+    MWS_ERROR_MEMORY = -4,
+    MWS_ERROR_INTERNAL = -5,
+};
+
+/* What mws_solve reached, see SolvingState */
+enum {
+    MWS_REDUCE = 0x1,
+    MWS_OVERLAP = 0x2,
+    MWS_PROBABILITY = 0x4,
+    MWS_HEURISTIC = 0x8, /* the blocks to open were not chosen in a degraded way */
+    MWS_APPROXIMATE = 0x10, /* the probabilities were sampled */
+};
+
+/* MWS_API_VERSION of the library, to be checked against the header */
+unsigned mws_api_version(void);
+
+/* Message of the last error on the calling thread, "" if none */
+const char *mws_last_error(void);
+
+/* New game of the size, mines and strategy of <config>, e.g. "FL-PSEQ-30-16-T99-SFAR" */
+int mws_game_create(const char *config, mws_game **game);
+/* Game saved by mws_game_save, to be played under the strategy of <config>; the size comes from <data> */
+int mws_game_load(const char *config, const void *data, size_t size, mws_game **game);
+/* NULL is ignored */
+void mws_game_destroy(mws_game *game);
+
+int mws_game_size(const mws_game *game, int *width, int *height, int *mines);
+
+/* The block is open and shows <degree> mines around */
+int mws_set_degree(mws_game *game, int block, int degree);
+/* The block is known to be a mine */
+int mws_set_mine(mws_game *game, int block);
+
+/* Solve for probabilities and blocks to open, within <budget_ms> milliseconds, or without limit if <= 0
+ * OUT reached: MWS_* flags of what was done; may be NULL
+ *
+ * Note: See GameMgr::Solve for what is given up on once the budget is used up.
+ */
+int mws_solve(mws_game *game, double budget_ms, unsigned *reached);
+
+/* Mine probability of every block into <out> of <capacity> doubles, as of the last mws_solve
+ * Note: MWS_ERROR_BUFFER if <capacity> is less than width * height.
+ */
+int mws_probabilities(const mws_game *game, double *out, size_t capacity);
+/* Blocks to open, as of the last mws_solve: those safe for sure, if any, else the preferred ones
+ * OUT count: how many; if more than <capacity>, MWS_ERROR_BUFFER is returned and nothing written
+ */
+int mws_best_blocks(const mws_game *game, int *out, size_t capacity, size_t *count);
+
+/* Compact snapshot of the game, including the solver, see GameMgr::Deflate
+ * OUT size: bytes needed; if more than <capacity>, MWS_ERROR_BUFFER is returned and nothing written
+ */
+int mws_game_save(const mws_game *game, void *out, size_t capacity, size_t *size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,6 +1,7 @@
 #include "random.h"
 #include <random>
 #include <algorithm>
+#include <optional>
 
 template <class T = std::mt19937, size_t N = T::state_size>
 auto ProperlySeededRandomEngine() -> typename std::enable_if<!!N, T>::type
@@ -13,10 +14,16 @@ auto ProperlySeededRandomEngine() -> typename std::enable_if<!!N, T>::type
     return seededEngine;
 }
 
-static std::mt19937_64 *m_random = nullptr;
+static thread_local std::optional<std::mt19937_64> m_random;
 
 void SeedEngine() {
-    m_random = new std::mt19937_64{ ProperlySeededRandomEngine<std::mt19937_64>() };
+    m_random.emplace(ProperlySeededRandomEngine<std::mt19937_64>());
+}
+
+void SeedEngine(uint64_t seed) {
+    if (!m_random)
+        m_random.emplace();
+    m_random->seed(seed);
 }
 
 int RandomInteger(int maxExclusive)
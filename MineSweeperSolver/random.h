@@ -1,6 +1,11 @@
 #pragma once
 #include "stdafx.h"
+#include <cstdint>
 
-/* static wrapper of std::mt19937_64 */
+/* static wrapper of std::mt19937_64
+ * Note: Each thread has its own engine, to be seeded before use.
+ */
 void SeedEngine();
+/* Reproducible alternative to the above */
+void SeedEngine(uint64_t seed);
 int RandomInteger(int maxExclusive);
@@ -0,0 +1,39 @@
+#include "sequential.hpp"
+
+#include <cmath>
+
+// log of the mixture martingale at rate <p>
+static double log_mixture(double s, double f, double p)
+{
+    // log Beta(1 + s, 1 + f) - log Beta(1, 1)
+    auto lbeta = std::lgamma(1 + s) + std::lgamma(1 + f) - std::lgamma(2 + s + f);
+    return lbeta - (s ? s * std::log(p) : 0) - (f ? f * std::log1p(-p) : 0);
+}
+
+std::pair<double, double> confidence_sequence(size_t succeeded, size_t total, double alpha)
+{
+    if (!total)
+        return { 0, 1 };
+
+    auto s = static_cast<double>(succeeded);
+    auto f = static_cast<double>(total - succeeded);
+    auto threshold = -std::log(alpha);
+    auto mle = s / (s + f);
+
+    // the mixture is convex in p and below the threshold at the MLE,
+    // so each side has exactly one crossing
+    auto bisect = [&](double in, double out) {
+        for (auto i = 0; i < 60; i++) {
+            auto mid = (in + out) / 2;
+            if (log_mixture(s, f, mid) < threshold)
+                in = mid;
+            else
+                out = mid;
+        }
+        return out;
+    };
+    return {
+        succeeded ? bisect(mle, 0) : 0,
+        succeeded < total ? bisect(mle, 1) : 1,
+    };
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+/* Anytime-valid confidence interval of a success rate, <alpha> being the error rate.
+ *
+ * Note: Unlike Clopper-Pearson, the interval covers the true rate
+ * simultaneously for all numbers of trials, so it remains valid
+ * even if one keeps checking it and stops as soon as it looks good.
+ *
+ * Note: Robbins' beta-binomial mixture martingale with a uniform prior
+ * is compared against 1 / <alpha> (Ville's inequality).
+ */
+std::pair<double, double> confidence_sequence(size_t succeeded, size_t total, double alpha);
@@ -34,6 +34,12 @@ void cache(int w, int h, int m) {
     CacheBinomials(w * h, m);
 }
 
+// solve within <ms> milliseconds, and tell how far it got
+SolvingState solveWithin(GameMgr &m, SolvingState maxDepth, bool shortcut, double ms) {
+    auto budget = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>{ ms });
+    return m.Solve(maxDepth, shortcut, Deadline{ budget });
+}
+
 std::string exportGame(const GameMgr &m) {
     std::stringstream ss;
     m.Save(ss);
@@ -173,6 +179,7 @@ EMSCRIPTEN_BINDINGS(mws) {
         .value("OVERLAP", SolvingState::Overlap)
         .value("PROBABILITY", SolvingState::Probability)
         .value("HEURISTIC", SolvingState::Heuristic)
+        .value("APPROXIMATE", SolvingState::Approximate)
         .value("DRAINED", SolvingState::Drained)
         .value("SEMI", SolvingState::Reduce | SolvingState::Overlap | SolvingState::Probability)
         .value("HEUR", SolvingState::Reduce | SolvingState::Overlap | SolvingState::Probability | SolvingState::Heuristic)
@@ -193,7 +200,8 @@ EMSCRIPTEN_BINDINGS(mws) {
         .constructor<int, int, int, bool, Strategy, bool>()
         .constructor<int, int, int, Strategy>()
         .function("openBlock", &GameMgr::OpenBlock)
-        .function("solve", &GameMgr::Solve)
+        .function("solve", static_cast<void (GameMgr::*)(SolvingState, bool)>(&GameMgr::Solve))
+        .function("solveWithin", &solveWithin)
         .function("semiAutomaticStep", &GameMgr::SemiAutomaticStep)
         .function("semiAutomatic", &GameMgr::SemiAutomatic)
         .function("automaticStep", &GameMgr::AutomaticStep)
@@ -213,6 +221,7 @@ EMSCRIPTEN_BINDINGS(mws) {
         .property("lastProbe", &GameMgr::GetLastProbe)
         .property("minProb", &GameMgr::GetMinProbability)
         .property("maxProb", &GameMgr::GetMaxProbability)
+        .property("probError", &GameMgr::GetProbabilityError)
         .function("blockPropertyOf", &GameMgr::GetBlockProperty)
         .function("setBlockDegree", &GameMgr::SetBlockDegree)
         .function("setBlockMine", &GameMgr::SetBlockMine)
@@ -85,7 +85,7 @@ void MineSweeperDemo::Update()
 
     for (auto i = 0; i < m_Width * m_Height; ++i)
     {
-        auto &b = m_Mgr->GetBlockProperties()[i];
+        auto b = m_Mgr->GetBlockProperty(i / m_Height, i % m_Height);
 
         auto label = m_Labels[i];
         auto color = m_Backs[i];
@@ -211,7 +211,7 @@ void MineSweeperDemo::Process()
             for (auto i = 0; i < cnt; ++i)
             {
                 auto blk = ptr[i];
-                auto &b = m_Mgr->GetBlockProperties()[blk];
+                auto b = m_Mgr->GetBlockProperty(blk / m_Height, blk % m_Height);
                 auto v = (b.X - m_LastX) * (b.X - m_LastX) + (b.Y - m_LastY) * (b.Y - m_LastY);
                 if (v < bestV)
                 {